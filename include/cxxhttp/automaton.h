@@ -0,0 +1,844 @@
+/* Combined regex automaton.
+ *
+ * Servlets are found by matching their resource regexen against the request,
+ * which with std::regex means running each of the regexen separately. Most of
+ * those regexen only use the basics, though: characters, character classes,
+ * groups, alternatives and repetition. Regexen like that can be compiled into a
+ * single automaton, which then tells us which of them match with one pass over
+ * the request, no matter how many of them there are.
+ *
+ * The automaton is built in two stages. Each regex is first compiled into a
+ * nondeterministic automaton, with all of them sharing the same start state.
+ * The deterministic automaton that is actually run is then built from that on
+ * demand, one state at a time, as requests come in. That way we only ever
+ * build the states that are actually used, which is usually a tiny fraction of
+ * what there could be.
+ *
+ * The nondeterministic automaton doesn't change while matching, so threads can
+ * share it, as long as each of them builds its own deterministic states.
+ *
+ * This only answers whether a regex matches, not what its subexpressions
+ * matched; std::regex still needs to do that part, but only for the regexen
+ * that are known to match.
+ *
+ * See also:
+ * * Project Documentation: https://ef.gy/documentation/cxxhttp
+ * * Project Source Code: https://github.com/ef-gy/cxxhttp
+ * * Licence Terms: https://github.com/ef-gy/cxxhttp/blob/master/COPYING
+ *
+ * @copyright
+ * This file is part of the cxxhttp project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ */
+#if !defined(CXXHTTP_AUTOMATON_H)
+#define CXXHTTP_AUTOMATON_H
+
+#include <algorithm>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace cxxhttp {
+/* Combined regex automaton.
+ *
+ * Regexen are added with an ID, and matching a string produces the IDs of all
+ * the regexen that match the whole string, like std::regex_match() would.
+ *
+ * The supported syntax is a subset of ECMAScript regexen: plain and escaped
+ * characters, `.`, character classes with ranges, the \d, \w and \s classes
+ * and their negations, groups with or without capturing, alternatives, the
+ * `?`, `*`, `+` and `{n,m}` quantifiers (lazy or not, which makes no
+ * difference when only matching) and the `^` and `$` anchors. Anything else,
+ * like back-references or lookahead, makes add() return 'false', and it's up
+ * to the caller to match that regex some other way.
+ */
+class automaton {
+ protected:
+  /* Placeholder for missing states and transitions. */
+  enum : std::size_t { none = ~std::size_t(0) };
+
+  /* Deterministic state.
+   *
+   * A set of nondeterministic states that we could be in at the same time.
+   * Only states that have a byte transition, `$` transitions or that accept
+   * are in the set, as all the others are only ever passed through.
+   */
+  struct state {
+    /* The nondeterministic states, sorted. */
+    std::vector<std::size_t> nodes;
+
+    /* Next state, by input byte; `none` for transitions not built yet. */
+    std::vector<std::size_t> next;
+
+    /* IDs of the regexen that match when we end up in this state. */
+    std::vector<std::size_t> accept;
+  };
+
+ public:
+  /* Deterministic automaton.
+   *
+   * The states that have been built while matching. Matching with a const
+   * automaton needs one of these to build the states in, and threads that
+   * match at the same time each need their own. They can be reused for as
+   * long as they like, and are flushed automatically when the regexen change,
+   * but only ever with the same automaton.
+   */
+  class deterministic {
+   protected:
+    friend class automaton;
+
+    /* Deterministic states that have been built so far. */
+    std::vector<state> states;
+
+    /* Deterministic states, by the nondeterministic states they consist of. */
+    std::map<std::vector<std::size_t>, std::size_t> index;
+
+    /* The deterministic start state, once it's been built. */
+    std::size_t start = none;
+
+    /* IDs of the regexen that match the empty string. */
+    std::vector<std::size_t> startAccept;
+
+    /* The automaton's <version> that the states were built for. */
+    std::size_t version = none;
+
+    /* How often the states have been thrown away. */
+    std::size_t flushes = 0;
+
+    /* Throw away all states.
+     *
+     * Needed whenever the nondeterministic states change, or when there's too
+     * many deterministic ones.
+     */
+    void flush(void) {
+      states.clear();
+      index.clear();
+      start = none;
+      flushes++;
+    }
+  };
+
+  /* Maximum number of deterministic states.
+   *
+   * States are only built as they're needed, but some combinations of regexen
+   * could make for a lot of them. If we get to this many, we throw away all
+   * the states and start over.
+   */
+  std::size_t maxStates = 1024;
+
+  /* Construct empty automaton. */
+  automaton(void) { clear(); }
+
+  /* Remove all regexen.
+   *
+   * Afterwards, the automaton won't match anything.
+   */
+  void clear(void) {
+    nodes = std::vector<node>(1);
+    version++;
+  }
+
+  /* Add a regex.
+   * @regex The regex to add.
+   * @id What to report when the regex matches.
+   *
+   * Compiles the regex and adds it to the automaton, unless it uses syntax
+   * that we don't support. The automaton stays the same in that case.
+   *
+   * @return 'true' if the regex was added.
+   */
+  bool add(const std::string &regex, std::size_t id) {
+    const std::size_t size = nodes.size();
+    compiler c{regex, 0, true, *this};
+    const fragment f = c.alternative();
+
+    if (!c.ok || c.pos != regex.size() || nodes.size() > maxNodes) {
+      nodes.resize(size);
+      return false;
+    }
+
+    nodes[f.out].accept.push_back(id);
+    nodes[0].epsilon.push_back(f.in);
+    version++;
+    return true;
+  }
+
+  /* Match a string and one of its prefixes.
+   * @text The string to match.
+   * @prefix Length of the prefix to also match.
+   * @atPrefix Gets the IDs of the regexen that match the prefix.
+   * @atEnd Gets the IDs of the regexen that match all of `text`.
+   * @d Where to build deterministic states.
+   *
+   * Both of the results are computed with a single pass over the string. IDs
+   * are sorted and appear at most once. This doesn't change the automaton, so
+   * it's safe to call on several threads at once, as long as each of them has
+   * its own `d`.
+   */
+  void match(const std::string &text, std::size_t prefix,
+             std::vector<std::size_t> &atPrefix,
+             std::vector<std::size_t> &atEnd, deterministic &d) const {
+    atPrefix.clear();
+    atEnd.clear();
+
+    if (d.version != version) {
+      d.flush();
+      d.version = version;
+    }
+    if (d.start == none) {
+      d.start = intern(d, closure({0}, true, false));
+      d.startAccept = accepted(closure({0}, true, true));
+    }
+
+    std::size_t s = d.start;
+    if (prefix == 0) {
+      atPrefix = d.startAccept;
+    }
+    if (text.empty()) {
+      atEnd = d.startAccept;
+      return;
+    }
+
+    for (std::size_t i = 0; i < text.size(); i++) {
+      s = step(d, s, static_cast<unsigned char>(text[i]));
+      if (d.states[s].nodes.empty()) {
+        // nothing can match past this point.
+        return;
+      }
+      if (i + 1 == prefix) {
+        atPrefix = d.states[s].accept;
+      }
+    }
+
+    atEnd = d.states[s].accept;
+  }
+
+  /* Match a string and one of its prefixes.
+   * @text The string to match.
+   * @prefix Length of the prefix to also match.
+   * @atPrefix Gets the IDs of the regexen that match the prefix.
+   * @atEnd Gets the IDs of the regexen that match all of `text`.
+   *
+   * Like the above, but builds the deterministic states in the automaton's
+   * own, so it's not safe to use on more than one thread at a time.
+   */
+  void match(const std::string &text, std::size_t prefix,
+             std::vector<std::size_t> &atPrefix,
+             std::vector<std::size_t> &atEnd) {
+    match(text, prefix, atPrefix, atEnd, own);
+  }
+
+  /* Match a string.
+   * @text The string to match.
+   *
+   * @return The sorted IDs of all the regexen that match all of `text`.
+   */
+  std::vector<std::size_t> match(const std::string &text) {
+    std::vector<std::size_t> atPrefix, atEnd;
+    match(text, 0, atPrefix, atEnd);
+    return atEnd;
+  }
+
+ protected:
+  /* Maximum number of nondeterministic states.
+   *
+   * Large repetition counts are compiled by repeating the repeated part, so
+   * something like `a{1000}` needs quite a few states. Regexen that would take
+   * us over this limit aren't added.
+   */
+  enum : std::size_t { maxNodes = 1 << 16 };
+
+  /* Nondeterministic state.
+   *
+   * There's a transition to `next` for every byte in `bytes`, and transitions
+   * that don't consume any input to all of `epsilon`. The transitions in
+   * `begin` can only be taken at the start of the input, and the ones in `end`
+   * only at the end, which is how we implement `^` and `$`.
+   */
+  struct node {
+    std::bitset<256> bytes;
+    std::size_t next = none;
+    std::vector<std::size_t> epsilon, begin, end;
+
+    /* IDs of the regexen that match when we get to this state. */
+    std::vector<std::size_t> accept;
+  };
+
+  /* Part of a nondeterministic automaton.
+   *
+   * Has a single state going in and a single state going out, where the latter
+   * has no transitions, yet.
+   */
+  struct fragment {
+    std::size_t in, out;
+  };
+
+  /* Regex compiler.
+   *
+   * A recursive descent parser that builds the nondeterministic states for a
+   * regex as it goes along. Sets `ok` to 'false' if it runs into anything it
+   * doesn't support.
+   */
+  struct compiler {
+    const std::string &regex;
+    std::size_t pos;
+    bool ok;
+    automaton &a;
+
+    /* Is there more regex to parse?
+     *
+     * @return 'true' if we're not at the end of the regex.
+     */
+    bool more(void) const { return ok && pos < regex.size(); }
+
+    /* Compile alternatives.
+     *
+     * Parses any number of sequences, separated by `|`, up to the end of the
+     * regex or the closing parenthesis of the current group.
+     *
+     * @return The compiled alternatives.
+     */
+    fragment alternative(void) {
+      fragment f = sequence();
+      while (more() && regex[pos] == '|') {
+        pos++;
+        const fragment g = sequence();
+        const fragment r{a.add(), a.add()};
+        a.nodes[r.in].epsilon = {f.in, g.in};
+        a.nodes[f.out].epsilon.push_back(r.out);
+        a.nodes[g.out].epsilon.push_back(r.out);
+        f = r;
+      }
+      return f;
+    }
+
+    /* Compile sequence.
+     *
+     * Parses atoms, and the quantifiers that go with them, until the end of
+     * the current alternative.
+     *
+     * @return The compiled sequence.
+     */
+    fragment sequence(void) {
+      const std::size_t e = a.add();
+      fragment f{e, e};
+      while (more() && regex[pos] != '|' && regex[pos] != ')') {
+        f = a.concatenate(f, repetition());
+      }
+      return f;
+    }
+
+    /* Compile atom with quantifier.
+     *
+     * Repetitions are compiled by parsing the atom again for each copy that
+     * is needed.
+     *
+     * @return The compiled atom, repeated as often as necessary.
+     */
+    fragment repetition(void) {
+      const std::size_t from = pos;
+      const bool assertion = regex[pos] == '^' || regex[pos] == '$';
+      const fragment f = atom();
+      std::size_t min = 1, max = 1;
+
+      if (!more() || !quantifier(min, max)) {
+        return f;
+      }
+      if (!ok || assertion || max == 0 || (more() && isQuantifier())) {
+        ok = false;
+        return f;
+      }
+      const std::size_t to = pos;
+
+      const bool unbounded = max == none;
+      const std::size_t copies =
+          unbounded ? std::max<std::size_t>(min, 1) : max;
+      const std::size_t e = a.add();
+      fragment r{e, e};
+
+      for (std::size_t i = 0; ok && i < copies; i++) {
+        fragment c = f;
+        if (i > 0) {
+          pos = from;
+          c = atom();
+        }
+        if (unbounded && i == copies - 1) {
+          c = min == 0 ? a.star(c) : a.plus(c);
+        } else if (i >= min) {
+          c = a.optional(c);
+        }
+        r = a.concatenate(r, c);
+        ok = ok && a.nodes.size() <= maxNodes;
+      }
+
+      pos = to;
+      return r;
+    }
+
+    /* Is there a quantifier next?
+     *
+     * @return 'true' if the next character would start a quantifier.
+     */
+    bool isQuantifier(void) const {
+      return std::string("?*+{").find(regex[pos]) != std::string::npos;
+    }
+
+    /* Parse quantifier.
+     * @min Set to the minimum number of repetitions.
+     * @max Set to the maximum number of repetitions, or `none`.
+     *
+     * Also skips a trailing `?`, for lazy quantifiers.
+     *
+     * @return 'true' if there was a quantifier.
+     */
+    bool quantifier(std::size_t &min, std::size_t &max) {
+      switch (regex[pos]) {
+        case '?':
+          min = 0;
+          max = 1;
+          break;
+        case '*':
+          min = 0;
+          max = none;
+          break;
+        case '+':
+          min = 1;
+          max = none;
+          break;
+        case '{':
+          pos++;
+          min = number();
+          max = min;
+          if (more() && regex[pos] == ',') {
+            pos++;
+            max = more() && regex[pos] == '}' ? none : number();
+          }
+          if (!more() || regex[pos] != '}' || min > max) {
+            ok = false;
+          }
+          break;
+        default:
+          return false;
+      }
+
+      pos++;
+      if (more() && regex[pos] == '?') {
+        pos++;
+      }
+      return true;
+    }
+
+    /* Parse repetition count.
+     *
+     * @return The count, if there is one and it's not too large.
+     */
+    std::size_t number(void) {
+      std::size_t n = 0, digits = 0;
+      for (; more() && regex[pos] >= '0' && regex[pos] <= '9'; pos++) {
+        n = n * 10 + std::size_t(regex[pos] - '0');
+        ok = ok && ++digits < 5;
+      }
+      ok = ok && digits > 0;
+      return n;
+    }
+
+    /* Compile atom.
+     *
+     * An atom is a group, a character class, a single character or an anchor.
+     *
+     * @return The compiled atom.
+     */
+    fragment atom(void) {
+      const char c = regex[pos++];
+      switch (c) {
+        case '(':
+          return group();
+        case '[':
+          return a.bytes(characterClass());
+        case '.':
+          return a.bytes(~(only('\n') | only('\r')));
+        case '\\':
+          return a.bytes(escape(false));
+        case '^':
+        case '$': {
+          const fragment f{a.add(), a.add()};
+          (c == '^' ? a.nodes[f.in].begin : a.nodes[f.in].end).push_back(f.out);
+          return f;
+        }
+        case ')':
+        case ']':
+        case '}':
+        case '?':
+        case '*':
+        case '+':
+        case '{':
+          ok = false;
+          return a.bytes({});
+        default:
+          return a.bytes(only(c));
+      }
+    }
+
+    /* Compile group.
+     *
+     * Groups may or may not be capturing, which is the same thing to us. Other
+     * kinds of groups, like lookahead, are not supported.
+     *
+     * @return The compiled group.
+     */
+    fragment group(void) {
+      if (more() && regex[pos] == '?') {
+        if (pos + 1 < regex.size() && regex[pos + 1] == ':') {
+          pos += 2;
+        } else {
+          ok = false;
+        }
+      }
+
+      const fragment f = alternative();
+      if (more() && regex[pos] == ')') {
+        pos++;
+      } else {
+        ok = false;
+      }
+      return f;
+    }
+
+    /* Parse character class.
+     *
+     * Parses everything between the brackets of a character class. Empty
+     * classes, nested brackets and ranges that don't just use ASCII are not
+     * supported.
+     *
+     * @return The bytes that are in the class.
+     */
+    std::bitset<256> characterClass(void) {
+      std::bitset<256> r;
+      const bool negate = more() && regex[pos] == '^';
+      pos += negate ? 1 : 0;
+      ok = ok && more() && regex[pos] != ']';
+
+      while (more() && regex[pos] != ']') {
+        const auto from = member();
+        if (pos + 1 < regex.size() && regex[pos] == '-' &&
+            regex[pos + 1] != ']') {
+          pos++;
+          const auto to = member();
+          ok = ok && from.count() == 1 && to.count() == 1;
+          const unsigned f = ok ? first(from) : 0, t = ok ? first(to) : 0;
+          ok = ok && f < 0x80 && t < 0x80 && f <= t;
+          r |= ok ? span(char(f), char(t)) : std::bitset<256>();
+        } else {
+          r |= from;
+        }
+      }
+
+      ok = ok && more();
+      pos++;
+      return negate ? ~r : r;
+    }
+
+    /* Parse character class member.
+     *
+     * @return The bytes for a single character or escape in a class.
+     */
+    std::bitset<256> member(void) {
+      const char c = regex[pos++];
+      if (c == '\\') {
+        return escape(true);
+      }
+      ok = ok && c != '[';
+      return only(c);
+    }
+
+    /* Parse escape.
+     * @inClass Whether the escape is in a character class.
+     *
+     * Escaped characters other than letters and digits stand for themselves,
+     * and there's the usual control character escapes and the \d, \w and \s
+     * classes. Everything else is not supported.
+     *
+     * @return The bytes the escape stands for.
+     */
+    std::bitset<256> escape(bool inClass) {
+      if (!more()) {
+        ok = false;
+        return {};
+      }
+
+      const char c = regex[pos++];
+      std::bitset<256> r;
+
+      switch (c) {
+        case 'n':
+          return only('\n');
+        case 'r':
+          return only('\r');
+        case 't':
+          return only('\t');
+        case 'f':
+          return only('\f');
+        case 'v':
+          return only('\v');
+        case 'd':
+        case 'D':
+          r = span('0', '9');
+          break;
+        case 'w':
+        case 'W':
+          r = span('0', '9') | span('A', 'Z') | span('a', 'z') | only('_');
+          break;
+        case 's':
+        case 'S':
+          r = span('\t', '\r') | only(' ');
+          break;
+        default:
+          if ((c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') ||
+              (c >= 'a' && c <= 'z')) {
+            ok = false;
+          }
+          return only(c);
+      }
+
+      // \D, \W and \S in a class would need a different kind of negation.
+      ok = ok && !(inClass && c >= 'A' && c <= 'Z');
+      return c >= 'A' && c <= 'Z' ? ~r : r;
+    }
+
+    /* A single byte.
+     * @c The byte.
+     *
+     * @return A set with only `c` in it.
+     */
+    static std::bitset<256> only(char c) {
+      std::bitset<256> r;
+      r.set(static_cast<unsigned char>(c));
+      return r;
+    }
+
+    /* First byte in a set.
+     * @b The set of bytes.
+     *
+     * @return The lowest byte in `b`.
+     */
+    static unsigned first(const std::bitset<256> &b) {
+      unsigned c = 0;
+      while (c < 255 && !b[c]) {
+        c++;
+      }
+      return c;
+    }
+
+    /* A range of bytes.
+     * @from The first byte.
+     * @to The last byte.
+     *
+     * @return A set with `from` through `to` in it.
+     */
+    static std::bitset<256> span(char from, char to) {
+      std::bitset<256> r;
+      for (unsigned char c = from; c <= to; c++) {
+        r.set(c);
+      }
+      return r;
+    }
+  };
+
+  /* Nondeterministic states.
+   *
+   * The first one is the start state, with transitions to all the regexen.
+   */
+  std::vector<node> nodes;
+
+  /* Changes whenever the nondeterministic states do. */
+  std::size_t version = 0;
+
+  /* Deterministic states for the non-const match(). */
+  deterministic own;
+
+  /* Add a nondeterministic state.
+   *
+   * @return The new state's index.
+   */
+  std::size_t add(void) {
+    nodes.push_back(node());
+    return nodes.size() - 1;
+  }
+
+  /* Fragment matching a single byte.
+   * @b The bytes to match.
+   *
+   * @return A fragment with a transition for all of `b`.
+   */
+  fragment bytes(const std::bitset<256> &b) {
+    const fragment f{add(), add()};
+    nodes[f.in].bytes = b;
+    nodes[f.in].next = f.out;
+    return f;
+  }
+
+  /* Concatenate fragments.
+   * @f The first fragment.
+   * @g The second fragment.
+   *
+   * @return A fragment for `f` followed by `g`.
+   */
+  fragment concatenate(const fragment &f, const fragment &g) {
+    nodes[f.out].epsilon.push_back(g.in);
+    return {f.in, g.out};
+  }
+
+  /* Optional fragment.
+   * @f The fragment.
+   *
+   * @return A fragment for `f`, or nothing.
+   */
+  fragment optional(const fragment &f) {
+    const fragment r{add(), add()};
+    nodes[r.in].epsilon = {f.in, r.out};
+    nodes[f.out].epsilon.push_back(r.out);
+    return r;
+  }
+
+  /* Repeated fragment.
+   * @f The fragment.
+   *
+   * @return A fragment for `f`, once or more often.
+   */
+  fragment plus(const fragment &f) {
+    const std::size_t out = add();
+    nodes[f.out].epsilon.push_back(f.in);
+    nodes[f.out].epsilon.push_back(out);
+    return {f.in, out};
+  }
+
+  /* Optional, repeated fragment.
+   * @f The fragment.
+   *
+   * @return A fragment for `f`, any number of times.
+   */
+  fragment star(const fragment &f) { return optional(plus(f)); }
+
+  /* Follow transitions that don't consume input.
+   * @from The states to start with.
+   * @atBegin Whether we're at the start of the input.
+   * @atEnd Whether we're at the end of the input.
+   *
+   * @return All the states that are reachable from `from` without consuming
+   *     any input, sorted.
+   */
+  std::vector<std::size_t> closure(std::vector<std::size_t> from, bool atBegin,
+                                   bool atEnd) const {
+    std::vector<bool> seen(nodes.size());
+    std::vector<std::size_t> r;
+
+    while (!from.empty()) {
+      const std::size_t n = from.back();
+      from.pop_back();
+      if (seen[n]) {
+        continue;
+      }
+      seen[n] = true;
+      r.push_back(n);
+
+      const node &s = nodes[n];
+      from.insert(from.end(), s.epsilon.begin(), s.epsilon.end());
+      if (atBegin) {
+        from.insert(from.end(), s.begin.begin(), s.begin.end());
+      }
+      if (atEnd) {
+        from.insert(from.end(), s.end.begin(), s.end.end());
+      }
+    }
+
+    std::sort(r.begin(), r.end());
+    return r;
+  }
+
+  /* Collect accepted IDs.
+   * @set Nondeterministic states.
+   *
+   * @return The sorted IDs of the regexen that any of `set` accept.
+   */
+  std::vector<std::size_t> accepted(const std::vector<std::size_t> &set) const {
+    std::vector<std::size_t> r;
+    for (const auto &n : set) {
+      r.insert(r.end(), nodes[n].accept.begin(), nodes[n].accept.end());
+    }
+    std::sort(r.begin(), r.end());
+    r.erase(std::unique(r.begin(), r.end()), r.end());
+    return r;
+  }
+
+  /* Find or build deterministic state.
+   * @d The deterministic states built so far.
+   * @set The nondeterministic states we could be in.
+   *
+   * Throws away all the existing states first if there's too many of them.
+   *
+   * @return The index of the deterministic state for `set`.
+   */
+  std::size_t intern(deterministic &d,
+                     const std::vector<std::size_t> &set) const {
+    std::vector<std::size_t> key;
+    for (const auto &n : set) {
+      const node &s = nodes[n];
+      if (s.bytes.any() || !s.end.empty() || !s.accept.empty()) {
+        key.push_back(n);
+      }
+    }
+
+    const auto it = d.index.find(key);
+    if (it != d.index.end()) {
+      return it->second;
+    }
+
+    if (d.states.size() >= maxStates) {
+      d.flush();
+    }
+
+    state s;
+    s.accept = accepted(closure(key, false, true));
+    s.nodes = key;
+    s.next = std::vector<std::size_t>(256, none);
+    d.states.push_back(s);
+    d.index[key] = d.states.size() - 1;
+    return d.states.size() - 1;
+  }
+
+  /* Take transition.
+   * @d The deterministic states built so far.
+   * @from The deterministic state we're in.
+   * @c The input byte.
+   *
+   * Builds the state we end up in, if it doesn't exist yet.
+   *
+   * @return The deterministic state we end up in.
+   */
+  std::size_t step(deterministic &d, std::size_t from, unsigned char c) const {
+    const std::size_t known = d.states[from].next[c];
+    if (known != none) {
+      return known;
+    }
+
+    std::vector<std::size_t> to;
+    for (const auto &n : d.states[from].nodes) {
+      if (nodes[n].bytes[c]) {
+        to.push_back(nodes[n].next);
+      }
+    }
+
+    const std::size_t f = d.flushes;
+    const std::size_t r = intern(d, closure(to, false, false));
+    if (f == d.flushes) {
+      d.states[from].next[c] = r;
+    }
+    return r;
+  }
+};
+}
+
+#endif
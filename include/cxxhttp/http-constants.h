@@ -26,6 +26,7 @@ namespace http {
  *
  * See also:
  * * https://www.w3.org/Protocols/rfc2616/rfc2616-sec10.html#sec10
+ * * https://tools.ietf.org/html/rfc6585
  * * https://tools.ietf.org/html/rfc7725
  */
 static const std::map<unsigned, const char *> status{
@@ -67,6 +68,7 @@ static const std::map<unsigned, const char *> status{
     {415, "Unsupported Media Type"},
     {416, "Requested Range Not Satisfiable"},
     {417, "Expectation Failed"},
+    {431, "Request Header Fields Too Large"},
     {451, "Unavailable For Legal Reasons"},
     // 5xx - Server Error
     {500, "Internal Server Error"},
@@ -112,6 +114,8 @@ enum status {
   stContent,
   /* Currently processing the request. */
   stProcessing,
+  /* Processing the request elsewhere; see sessionData::resume. */
+  stDeferred,
   /* An error has occurred, and we won't continue parsing. */
   stError,
   /* Will shut down the connection now. Set in the destructor. */
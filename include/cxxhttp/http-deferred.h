@@ -0,0 +1,149 @@
+/* Deferred replies.
+ *
+ * Servlet handlers normally reply before they return. Some can't, e.g. because
+ * they need to ask an upstream server first, and blocking the I/O thread until
+ * that server answers would stall every other connection. Those handlers can
+ * defer their reply instead, and send it whenever they're ready.
+ *
+ * See also:
+ * * Project Documentation: https://ef.gy/documentation/cxxhttp
+ * * Project Source Code: https://github.com/ef-gy/cxxhttp
+ * * Licence Terms: https://github.com/ef-gy/cxxhttp/blob/master/COPYING
+ *
+ * @copyright
+ * This file is part of the cxxhttp project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ */
+#if !defined(CXXHTTP_HTTP_DEFERRED_H)
+#define CXXHTTP_HTTP_DEFERRED_H
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+
+#include <cxxhttp/http-error.h>
+#include <cxxhttp/http-header.h>
+#include <cxxhttp/http-session.h>
+
+namespace cxxhttp {
+namespace http {
+/* Deferred reply token.
+ *
+ * Construct one of these in a handler to defer the reply to the request it's
+ * handling. The handler can then return, and keep a copy of the token to reply
+ * with later, from any thread. The session stops reading further requests until
+ * then.
+ *
+ * Only the first reply counts. If none comes in before the timeout, the client
+ * gets a 504 instead, and if the last copy of the token goes away without
+ * replying, it gets a 500.
+ *
+ * Replies can only be deferred by handlers that run on the session's own
+ * strand, i.e. not by those of blocking servlets, which can simply take their
+ * time instead. Tokens that can't defer a reply are not valid(), and replying
+ * with them does nothing.
+ */
+class deferred {
+ public:
+  /* Defer the reply to a request.
+   * @pSession The session that's handling the request.
+   * @pTimeout How long to wait for the reply; 0 to wait forever. Defaults to
+   *     30 seconds.
+   *
+   * Tags the session's request as deferred. It's up to the token to reply to it
+   * from now on.
+   */
+  deferred(sessionData &pSession,
+           std::chrono::milliseconds pTimeout = std::chrono::seconds(30)) {
+    if (pSession.resume && pSession.status == stProcessing) {
+      state = std::make_shared<shared>(pSession);
+
+      const std::weak_ptr<shared> weak = state;
+      pSession.status = stDeferred;
+      pSession.deferTimeout = pTimeout;
+      pSession.expire = [weak] {
+        if (auto s = weak.lock()) {
+          s->finish([](sessionData &session) { error(session).reply(504); });
+        }
+      };
+    }
+  }
+
+  /* Is the token valid?
+   *
+   * @return 'true' if the reply has been deferred, and the token is the one to
+   * reply with.
+   */
+  bool valid(void) const { return state != nullptr; }
+
+  /* Reply to the request.
+   * @status The status to return.
+   * @body The response body to send back to the client.
+   * @header The headers to send.
+   *
+   * Sends the reply like sessionData::reply() would, on the session's strand.
+   *
+   * @return 'true' if this is the reply that will be sent.
+   */
+  bool reply(int status, std::string body, const headers &header = {}) const {
+    const auto b = std::make_shared<const std::string>(std::move(body));
+    return finish([status, b, header](sessionData &session) {
+      session.reply(status, b, header);
+    });
+  }
+
+  /* Finish the request.
+   * @then What to do with the session; this needs to reply.
+   *
+   * For anything that reply() doesn't cover. `then` is run on the session's
+   * strand, and can use the session like a handler would.
+   *
+   * @return 'true' if this is the reply that will be sent.
+   */
+  bool finish(std::function<void(sessionData &)> then) const {
+    return state && state->finish(std::move(then));
+  }
+
+ protected:
+  /* State shared by all copies of a token. */
+  struct shared {
+    /* The session that's waiting for the reply. */
+    sessionData &session;
+
+    /* Whether there's been a reply, or a timeout. */
+    std::atomic<bool> done{false};
+
+    /* Remember the session.
+     * @pSession The session that's waiting for the reply.
+     */
+    shared(sessionData &pSession) : session(pSession) {}
+
+    /* Send a 500 if nobody replied. */
+    ~shared(void) {
+      finish([](sessionData &s) { error(s).reply(500); });
+    }
+
+    /* Finish the request, unless that's already happened.
+     * @then What to do with the session on its strand.
+     *
+     * @return 'true' if this is the first time the request was finished.
+     */
+    bool finish(std::function<void(sessionData &)> then) {
+      if (done.exchange(true)) {
+        return false;
+      }
+
+      sessionData &s = session;
+      session.resume([&s, then] { then(s); });
+      return true;
+    }
+  };
+
+  /* State shared by all copies of the token; null if not valid(). */
+  std::shared_ptr<shared> state;
+};
+}
+}
+
+#endif
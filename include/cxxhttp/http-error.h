@@ -50,8 +50,8 @@ class error {
    * This constructs and sends a simple error reply to the client.
    */
   void reply(unsigned status) const {
-    std::string type = negotiate(session.inbound.get("Accept"),
-                                 "text/markdown, text/plain;q=0.9");
+    static const negotiator accept("text/markdown, text/plain;q=0.9");
+    std::string type = negotiate(session.inbound.get("Accept"), accept);
     bool negotiationSuccess = !type.empty();
 
     if (type.empty()) {
@@ -72,7 +72,7 @@ class error {
       p.append("Allow", m);
     }
 
-    session.reply(status, body, p.header);
+    session.reply(status, std::move(body), p.header);
   }
 
  protected:
@@ -16,13 +16,17 @@
 #define CXXHTTP_HTTP_FLOW_H
 
 #include <functional>
+#include <list>
+#include <memory>
 #include <system_error>
+#include <vector>
 
 #define ASIO_STANDALONE
 #include <asio.hpp>
 
 #include <cxxhttp/http-session.h>
 #include <cxxhttp/http-error.h>
+#include <cxxhttp/scan.h>
 
 namespace cxxhttp {
 namespace http {
@@ -50,6 +54,58 @@ template <>
 inline void maybeShutdown<asio::posix::stream_descriptor>(
     asio::posix::stream_descriptor &connection, asio::error_code &ec) {}
 
+/* Match condition for a complete header block.
+ *
+ * Used with asio::async_read_until() to read everything up to and including the
+ * empty line at the end of a header block. Either CRLF or plain LF line endings
+ * are fine, same as with the line parsers.
+ *
+ * To keep a misbehaving peer from making us buffer forever, this also reports a
+ * match once the input buffer has grown to `limit` bytes. Whoever gets called
+ * next then needs to notice that the header is not actually complete.
+ *
+ * The data in an asio::streambuf is always contiguous, which lets us run the
+ * vectorised scan::headerEnd() over it directly.
+ */
+class endOfHeader {
+ public:
+  /* Iterator type used by asio for the input buffer. */
+  using iterator = asio::buffers_iterator<asio::streambuf::const_buffers_type>;
+
+  /* Result type, as required by asio: where to stop, and whether we did. */
+  using result_type = std::pair<iterator, bool>;
+
+  /* Input buffer to read into. Only used for its size. */
+  const asio::streambuf *input;
+
+  /* Maximum header block size, in bytes. */
+  std::size_t limit;
+
+  /* Look for the end of the header block.
+   * @begin Where to start looking.
+   * @end Where to stop looking.
+   *
+   * @return The position right after the header block and 'true', if found;
+   * otherwise the position to resume looking at and 'false'.
+   */
+  result_type operator()(iterator begin, iterator end) const {
+    if (begin != end) {
+      const std::size_t n = scan::headerEnd(stringView(&*begin, end - begin));
+      if (n != stringView::npos) {
+        return result_type(begin + n, true);
+      }
+    }
+
+    if (input->size() >= limit) {
+      return result_type(end, true);
+    }
+
+    // a partial terminator is at most "\n\r", so we need to look at those two
+    // characters again once there's more data.
+    return result_type(end - begin > 2 ? end - 2 : begin, false);
+  }
+};
+
 /* HTTP I/O control flow.
  * @requestProcessor The functor class to handle requests.
  * @inputType An ASIO-compatible type for the input stream.
@@ -90,6 +146,60 @@ class flow {
    */
   sessionData &session;
 
+  /* Whether to read complete header blocks.
+   *
+   * If set, the start line and all headers are read with a single read, and
+   * then parsed in one go. Otherwise every line gets a read of its own, which
+   * is a lot slower but makes it easier to follow along when debugging, e.g.
+   * when talking to the session over STDIO.
+   */
+  bool readBlocks;
+
+  /* Messages that are currently being written.
+   *
+   * Messages are moved here from the session's <outboundQueue> when their write
+   * starts, because the write refers to the messages' data instead of copying
+   * it, so they need to stay put until the write is done.
+   */
+  std::list<message> writing;
+
+  /* Maximum number of bytes to send with a single write.
+   *
+   * send() combines as many queued messages as it can into one write, up to
+   * this many bytes. A message that is larger than this on its own is still
+   * sent, but by itself.
+   */
+  std::size_t maxWriteBytes;
+
+  /* Maximum number of buffers to send with a single write.
+   *
+   * Each message needs one or two buffers, one for its header block and one
+   * for its body. ASIO won't hand more than 64 buffers to the OS at once.
+   */
+  std::size_t maxWriteBuffers;
+
+  /* Maximum header block size.
+   *
+   * Header blocks, including the start line, that exceed this many bytes are
+   * rejected. Only enforced when `readBlocks` is set.
+   */
+  std::size_t maxHeaderLength;
+
+  /* Handler strand.
+   *
+   * All of the flow's completion handlers run through this, so a session is
+   * only ever worked on by one thread at a time, even if the I/O service is
+   * run on several of them.
+   */
+  asio::io_service::strand strand;
+
+  /* Called once the session has been tagged as free.
+   *
+   * Lets whatever owns the session know that it can be reused, e.g. by putting
+   * it back into a pool.
+   */
+  std::function<void(void)> released;
+
   /* Construct with I/O service.
    * @pProcessor Reference to the HTTP processor to use.
    * @service Which ASIO I/O service to bind to.
@@ -104,7 +214,18 @@ class flow {
       : processor(pProcessor),
         inputConnection(service),
         outputConnection(inputConnection),
-        session(pSession) {}
+        session(pSession),
+        readBlocks(true),
+        maxWriteBytes(1024 * 1024),
+        maxWriteBuffers(64),
+        maxHeaderLength(1024 * 64),
+        strand(service),
+        io(service),
+        timer(service) {
+    session.resume = [this](std::function<void(void)> then) {
+      resume(std::move(then));
+    };
+  }
 
   /* Construct with I/O service and input/output data.
    * @T Input and output connection parameter type.
@@ -124,7 +245,18 @@ class flow {
       : processor(pProcessor),
         inputConnection(service, pInput),
         outputConnection(service, pOutput),
-        session(pSession) {}
+        session(pSession),
+        readBlocks(true),
+        maxWriteBytes(1024 * 1024),
+        maxWriteBuffers(64),
+        maxHeaderLength(1024 * 64),
+        strand(service),
+        io(service),
+        timer(service) {
+    session.resume = [this](std::function<void(void)> then) {
+      resume(std::move(then));
+    };
+  }
 
   /* Destructor.
    *
@@ -135,29 +267,37 @@ class flow {
 
   /* Start processing.
    *
-   * Starts processing the incoming request.
+   * Starts processing the incoming request, on the strand.
    */
   void start(void) {
-    processor.start(session);
-    handleStart();
+    strand.dispatch([this] {
+      processor.start(session);
+      handleStart();
+    });
   }
 
-  /* Send the next message.
+  /* Send queued messages.
    *
-   * Sends the next message in the <outboundQueue>, if there is one and no
-   * message is currently in flight.
+   * Sends the messages in the <outboundQueue>, if there are any and no message
+   * is currently in flight. As many messages as fit within <maxWriteBytes> and
+   * <maxWriteBuffers> are sent with a single gather write, which helps a lot
+   * with pipelined requests.
    */
   void send(void) {
-    if (session.status != stShutdown && !session.writePending) {
+    if (session.status != stShutdown && session.status != stDeferred &&
+        !session.writePending) {
       if (session.outboundQueue.size() > 0) {
-        session.writePending = true;
-        const std::string &msg = session.outboundQueue.front();
+        std::vector<asio::const_buffer> buffers;
+        gather(session.outboundQueue, writing, buffers, maxWriteBytes,
+               maxWriteBuffers);
 
-        asio::async_write(
-            outputConnection, asio::buffer(msg),
-            std::bind(&flow::handleWrite, this, std::placeholders::_1));
+        session.writePending = true;
+        session.writes++;
+        outstanding++;
 
-        session.outboundQueue.pop_front();
+        asio::async_write(outputConnection, buffers,
+                          strand.wrap(std::bind(&flow::handleWrite, this,
+                                                std::placeholders::_1)));
       } else if (session.closeAfterSend) {
         recycle();
       }
@@ -170,10 +310,31 @@ class flow {
    * for processing in the input buffer.
    */
   void readLine(void) {
+    outstanding++;
     asio::async_read_until(
         inputConnection, session.input, "\n",
-        std::bind(&flow::handleRead, this, std::placeholders::_1,
-                  std::placeholders::_2));
+        strand.wrap(std::bind(&flow::handleRead, this, std::placeholders::_1,
+                              std::placeholders::_2)));
+  }
+
+  /* Read enough off the input socket to fill a header block.
+   *
+   * Issue a read that will make sure the start line and all header lines are
+   * available in the input buffer. Falls back to reading a single line if we
+   * don't read header blocks.
+   */
+  void readHeader(void) {
+    if (!readBlocks) {
+      readLine();
+      return;
+    }
+
+    outstanding++;
+    asio::async_read_until(
+        inputConnection, session.input,
+        endOfHeader{&session.input, maxHeaderLength},
+        strand.wrap(std::bind(&flow::handleRead, this, std::placeholders::_1,
+                              std::placeholders::_2)));
   }
 
   /* Read remainder of the request body.
@@ -182,19 +343,54 @@ class flow {
    * anything left to read.
    */
   void readRemainingContent(void) {
-    asio::async_read(inputConnection, session.input,
-                     asio::transfer_at_least(session.remainingBytes()),
-                     std::bind(&flow::handleRead, this, std::placeholders::_1,
-                               std::placeholders::_2));
+    outstanding++;
+    asio::async_read(
+        inputConnection, session.input,
+        asio::transfer_at_least(session.remainingBytes()),
+        strand.wrap(std::bind(&flow::handleRead, this, std::placeholders::_1,
+                              std::placeholders::_2)));
+  }
+
+  /* Resume a deferred request.
+   * @then What to do on the strand before carrying on.
+   *
+   * This is what the session's `resume` calls. Posts `then` to the strand, and
+   * once that's been run, carries on with the session as though the request
+   * had just been processed.
+   */
+  void resume(std::function<void(void)> then) {
+    strand.post([this, then] {
+      outstanding--;
+      busy.reset();
+      timer.cancel();
+      session.expire = nullptr;
+      if (draining) {
+        release();
+        return;
+      }
+
+      session.status = stProcessing;
+      then();
+      processed();
+
+      if (session.status == stError) {
+        recycle();
+      }
+    });
   }
 
   /* Make session reusable for future use.
    *
    * Destroys all pending data that needs to be cleaned up, and tags the session
    * as clean. This allows reusing the session, or destruction out of band.
+   *
+   * Closing the connection cancels any reads or writes that are still going,
+   * but their handlers are still called. The session is only tagged as clean
+   * once they have been, so none of them can run after the session has been
+   * picked up for a new connection.
    */
   void recycle(void) {
-    if (!session.free) {
+    if (!session.free && !draining) {
       processor.recycle(session);
 
       session.status = stShutdown;
@@ -220,11 +416,69 @@ class flow {
 
       session.input.consume(session.input.size() + 1);
 
-      session.free = true;
+      draining = true;
+      release();
     }
   }
 
  protected:
+  /* Number of reads and writes whose handlers haven't been called yet. */
+  std::size_t outstanding = 0;
+
+  /* Whether the session has been recycled, but isn't free yet. */
+  bool draining = false;
+
+  /* The I/O service that the flow runs on. */
+  asio::io_service &io;
+
+  /* Keeps the I/O service running while a request is deferred. */
+  std::unique_ptr<asio::io_service::work> busy;
+
+  /* Times out deferred requests. */
+  asio::steady_timer timer;
+
+  /* Tag a recycled session as free.
+   *
+   * Does so once the handlers of all the reads and writes that were cancelled
+   * by recycle() have been called, and then calls <released>.
+   */
+  void release(void) {
+    if (draining && outstanding == 0) {
+      draining = false;
+      session.free = true;
+      if (released) {
+        released();
+      }
+    }
+  }
+
+  /* Carry on after processing a request.
+   *
+   * Asks the processor what to do next and does that, unless the request has
+   * been deferred. In that case, the deferral counts as an outstanding
+   * operation until resume() is called, so the session can't be recycled and
+   * handed out again before then. If the session has a <deferTimeout>, that's
+   * when handleTimeout() gets to give up on the request.
+   */
+  void processed(void) {
+    if (session.status == stDeferred) {
+      outstanding++;
+      busy.reset(new asio::io_service::work(io));
+
+      if (session.deferTimeout.count() > 0) {
+        outstanding++;
+        timer.expires_from_now(session.deferTimeout);
+        timer.async_wait(strand.wrap(
+            std::bind(&flow::handleTimeout, this, std::placeholders::_1)));
+        session.deferTimeout = std::chrono::milliseconds(0);
+      }
+      return;
+    }
+
+    session.status = processor.afterProcessing(session);
+    handleStart();
+  }
+
   /* Decide what to do after an initial setup.
    *
    * This does what start() does after telling the processor to get going. We
@@ -232,45 +486,49 @@ class flow {
    */
   void handleStart(void) {
     if (session.status == stRequest || session.status == stStatus) {
-      readLine();
+      readHeader();
     } else if (session.status == stShutdown) {
       recycle();
     }
     send();
   }
 
-  /* Callback after more data has been read.
-   * @error Current error state.
-   * @length Length of the read; ignored.
-   *
-   * Called by ASIO to indicate that new data has been read and can now be
-   * processed.
+  /* Is there a complete line in the input buffer?
    *
-   * The actual processing for the header is done with a set of regexen, which
-   * greatly simplifies the header parsing.
+   * @return 'true' if the input buffer contains a newline.
    */
-  void handleRead(const std::error_code &error, std::size_t length) {
-    if (session.status == stShutdown) {
-      return;
-    } else if (error) {
-      session.status = stError;
-    }
+  bool haveLine(void) const {
+    const stringView line = session.line();
+    return !line.empty() && line.back() == '\n';
+  }
 
+  /* Process a single start or header line.
+   *
+   * Start lines and headers are parsed straight out of the input buffer, one
+   * line at a time, and the line is only consumed after it's been parsed.
+   */
+  void absorbLine(void) {
     bool wasRequest = session.status == stRequest;
     bool wasStart = wasRequest || session.status == stStatus;
     http::version version;
     static const http::version limVersion{2, 0};
 
     if (session.status == stRequest) {
-      session.inboundRequest = session.buffer();
+      const stringView line = session.line();
+      session.inboundRequest = line;
+      session.input.consume(line.size());
       session.status = session.inboundRequest.valid() ? stHeader : stError;
       version = session.inboundRequest.version;
     } else if (session.status == stStatus) {
-      session.inboundStatus = session.buffer();
+      const stringView line = session.line();
+      session.inboundStatus = line;
+      session.input.consume(line.size());
       session.status = session.inboundStatus.valid() ? stHeader : stError;
       version = session.inboundStatus.version;
     } else if (session.status == stHeader) {
-      session.inbound.absorb(session.buffer());
+      const stringView line = session.line();
+      session.inbound.absorb(line);
+      session.input.consume(line.size());
       // this may return false, and if it did then what the client sent was
       // not valid HTTP and we should send back an error.
       if (session.inbound.complete) {
@@ -298,9 +556,43 @@ class flow {
       send();
       session.status = stProcessing;
     }
+  }
+
+  /* Callback after more data has been read.
+   * @error Current error state.
+   * @length Length of the read; ignored.
+   *
+   * Called by ASIO to indicate that new data has been read and can now be
+   * processed.
+   *
+   * When reading header blocks, everything up to the end of the header has
+   * been read at this point, so all of those lines are parsed right away.
+   */
+  void handleRead(const std::error_code &error, std::size_t length) {
+    outstanding--;
+    if (session.status == stShutdown) {
+      release();
+      return;
+    } else if (error) {
+      session.status = stError;
+    }
+
+    do {
+      absorbLine();
+    } while (readBlocks && session.status == stHeader && haveLine());
 
     if (session.status == stHeader) {
-      readLine();
+      if (!readBlocks) {
+        readLine();
+      } else if (session.inboundRequest.valid()) {
+        // the only way to run out of lines in the middle of a header block is
+        // for the block to be too large.
+        http::error(session).reply(431);
+        send();
+        session.status = stProcessing;
+      } else {
+        session.status = stError;
+      }
     } else if (session.status == stContent) {
       session.content += session.buffer();
       if (session.remainingBytes() == 0) {
@@ -308,9 +600,7 @@ class flow {
 
         /* processing the request takes place here */
         processor.handle(session);
-
-        session.status = processor.afterProcessing(session);
-        handleStart();
+        processed();
       } else {
         readRemainingContent();
       }
@@ -321,6 +611,21 @@ class flow {
     }
   }
 
+  /* Deferred request timeout handler.
+   * @error Current error state; set if the timer was cancelled.
+   *
+   * Has the session give up on a deferred request that is still deferred when
+   * the timer runs out.
+   */
+  void handleTimeout(const std::error_code &error) {
+    outstanding--;
+    if (draining) {
+      release();
+    } else if (!error && session.status == stDeferred && session.expire) {
+      session.expire();
+    }
+  }
+
   /* Asynchronouse write handler
    * @error Current error state.
    *
@@ -331,7 +636,18 @@ class flow {
    * connection automagically.
    */
   void handleWrite(const std::error_code error) {
+    outstanding--;
     session.writePending = false;
+    writing.clear();
+
+    if (draining) {
+      release();
+      return;
+    } else if (session.status == stDeferred) {
+      // the handler may be queueing replies right now, so leave everything
+      // else to resume(). Errors come up again with the next write.
+      return;
+    }
 
     if (!error) {
       if (session.status == stProcessing) {
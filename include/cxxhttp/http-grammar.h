@@ -1,6 +1,8 @@
 /* HTTP protocol grammar fragments.
  *
- * Mostly in the form of regular expressions. Where possible, anyway.
+ * Mostly in the form of regular expressions. Where possible, anyway. The
+ * character classes are also available as a lookup table, along with some
+ * validation functions, for when std::regex would be too slow.
  *
  * See also:
  * * Project Documentation: https://ef.gy/documentation/cxxhttp
@@ -15,6 +17,10 @@
 #define CXXHTTP_HTTP_GRAMMAR_H
 
 #include <string>
+#include <utility>
+
+#include <cxxhttp/scan.h>
+#include <cxxhttp/string.h>
 
 namespace cxxhttp {
 namespace http {
@@ -291,6 +297,329 @@ static const std::string fieldVcharWS = "[ \t!-\\\x7e\\\x80-\\\xff]";
  *      field-content  = field-vchar [ 1*( SP / HTAB ) field-vchar ]
  */
 static const std::string fieldContent = fieldVchar + fieldVcharWS + "*";
+
+// Character classes.
+//
+// The same character classes as above, but for code that scans input by hand
+// instead of going through std::regex. Each character's classes are looked up
+// in a table that is built at compile time, so checking any one class costs a
+// load and a bit test. These must stay in sync with the regex fragments.
+
+/* Character class flags.
+ *
+ * Each entry in the `characters` table is a combination of these.
+ */
+enum characterClass : unsigned short {
+  /* `alpha` */
+  ccAlpha = 1 << 0,
+  /* `digit` */
+  ccDigit = 1 << 1,
+  /* `vchar` */
+  ccVchar = 1 << 2,
+  /* `wsp` */
+  ccWhitespace = 1 << 3,
+  /* `obsText` */
+  ccObsText = 1 << 4,
+  /* `tchar` */
+  ccTchar = 1 << 5,
+  /* `qdtext` */
+  ccQdtext = 1 << 6,
+  /* `ctext` */
+  ccCtext = 1 << 7,
+  /* `fieldVchar` */
+  ccFieldVchar = 1 << 8,
+  /* `fieldVcharWS`, which is also what `reasonPhrase` is made of. */
+  ccFieldVcharWS = 1 << 9,
+  /* Characters we accept in a request method; see requestLine. */
+  ccMethod = 1 << 10,
+  /* Characters we accept in a request target; see requestLine. */
+  ccTarget = 1 << 11,
+  /* RFC 2045 token characters, as used in MIME types; see mimeType. */
+  ccMimeToken = 1 << 12,
+};
+
+/* Is a character in a list?
+ * @c The character to look for.
+ * @list The characters to look at.
+ *
+ * Only used to build the character class table.
+ *
+ * @return 'true' if `c` is one of the characters in `list`.
+ */
+static constexpr bool oneOf(unsigned c, const char *list) {
+  return *list != 0 &&
+         (static_cast<unsigned char>(*list) == c || oneOf(c, list + 1));
+}
+
+/* Is a character in a range?
+ * @c The character to look at.
+ * @first The first character in the range.
+ * @last The last character in the range.
+ *
+ * Only used to build the character class table.
+ *
+ * @return 'true' if `first <= c <= last`.
+ */
+static constexpr bool inRange(unsigned c, unsigned first, unsigned last) {
+  return c >= first && c <= last;
+}
+
+/* Classify a character.
+ * @c The character to classify.
+ *
+ * Spells out the grammar rules for each of the character classes. This is only
+ * used to build the `characters` table at compile time.
+ *
+ * @return The combined characterClass flags for `c`.
+ */
+static constexpr unsigned short classify(unsigned c) {
+  return (inRange(c, 'A', 'Z') || inRange(c, 'a', 'z') ? ccAlpha : 0) |
+         (inRange(c, '0', '9') ? ccDigit : 0) |
+         (inRange(c, 0x21, 0x7e) ? ccVchar | ccFieldVchar | ccFieldVcharWS
+                                 : 0) |
+         (c == ' ' || c == '\t' ? ccWhitespace | ccFieldVcharWS : 0) |
+         (inRange(c, 0x80, 0xff)
+              ? ccObsText | ccFieldVchar | ccFieldVcharWS | ccQdtext | ccCtext
+              : 0) |
+         (inRange(c, 'A', 'Z') || inRange(c, 'a', 'z') ||
+                  inRange(c, '0', '9') || oneOf(c, "!#$%&'*+-.^_`|~")
+              ? ccTchar
+              : 0) |
+         (c == '\t' || c == ' ' || c == 0x21 || inRange(c, 0x23, 0x5b) ||
+                  inRange(c, 0x5d, 0x7e)
+              ? ccQdtext
+              : 0) |
+         (c == '\t' || c == ' ' || inRange(c, 0x21, 0x27) ||
+                  inRange(c, 0x2a, 0x5b) || inRange(c, 0x5d, 0x7e)
+              ? ccCtext
+              : 0) |
+         (inRange(c, 'A', 'Z') || inRange(c, 'a', 'z') ||
+                  inRange(c, '0', '9') || c == '_'
+              ? ccMethod | ccTarget
+              : 0) |
+         (oneOf(c, "%/.:;()+?=&-") ? ccTarget : 0) |
+         (inRange(c, 0x21, 0x7e) && !oneOf(c, "()<>@,;:\\\"/[]?=")
+              ? ccMimeToken
+              : 0);
+}
+
+/* Character class table.
+ *
+ * One set of characterClass flags for each possible 8-bit character.
+ */
+struct characterTable {
+  unsigned short flags[256];
+};
+
+/* Build the character class table.
+ * @c All the characters to classify; 0 through 255.
+ *
+ * @return A table with the classes of all characters.
+ */
+template <std::size_t... c>
+static constexpr characterTable makeCharacterTable(std::index_sequence<c...>) {
+  return characterTable{{classify(c)...}};
+}
+
+/* The character class table.
+ *
+ * Built at compile time; use is() to look things up in it.
+ */
+static constexpr characterTable characters =
+    makeCharacterTable(std::make_index_sequence<256>());
+
+/* Is a character in a class?
+ * @c The character to check.
+ * @cls The class, or classes, to check against.
+ *
+ * @return 'true' if `c` is in any of the classes in `cls`.
+ */
+static inline bool is(unsigned char c, unsigned short cls) {
+  return (characters.flags[c] & cls) != 0;
+}
+
+/* Are all characters in a class?
+ * @text The text to check.
+ * @cls The class, or classes, to check against.
+ *
+ * @return 'true' if every character in `text` is in any of the classes in
+ * `cls`. Also 'true' if `text` is empty.
+ */
+static inline bool allOf(const stringView &text, unsigned short cls) {
+  for (const auto &c : text) {
+    if (!is(c, cls)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Is this a DIGIT?
+ * @c The character to check.
+ *
+ * @return 'true' if `c` matches the `digit` class.
+ */
+static inline bool isDigit(unsigned char c) { return is(c, ccDigit); }
+
+/* Is this an ALPHA?
+ * @c The character to check.
+ *
+ * @return 'true' if `c` matches the `alpha` class.
+ */
+static inline bool isAlpha(unsigned char c) { return is(c, ccAlpha); }
+
+/* Is this a VCHAR?
+ * @c The character to check.
+ *
+ * @return 'true' if `c` matches the `vchar` class.
+ */
+static inline bool isVchar(unsigned char c) { return is(c, ccVchar); }
+
+/* Is this whitespace?
+ * @c The character to check.
+ *
+ * @return 'true' if `c` matches the `wsp` class.
+ */
+static inline bool isWhitespace(unsigned char c) {
+  return is(c, ccWhitespace);
+}
+
+/* Is this obsolete text?
+ * @c The character to check.
+ *
+ * @return 'true' if `c` matches the `obsText` class.
+ */
+static inline bool isObsText(unsigned char c) { return is(c, ccObsText); }
+
+/* Is this a tchar?
+ * @c The character to check.
+ *
+ * @return 'true' if `c` matches the `tchar` class.
+ */
+static inline bool isTchar(unsigned char c) { return is(c, ccTchar); }
+
+/* Is this qdtext?
+ * @c The character to check.
+ *
+ * @return 'true' if `c` matches the `qdtext` class.
+ */
+static inline bool isQdtext(unsigned char c) { return is(c, ccQdtext); }
+
+/* Is this ctext?
+ * @c The character to check.
+ *
+ * @return 'true' if `c` matches the `ctext` class.
+ */
+static inline bool isCtext(unsigned char c) { return is(c, ccCtext); }
+
+/* Is this a field-vchar?
+ * @c The character to check.
+ *
+ * @return 'true' if `c` matches the `fieldVchar` class.
+ */
+static inline bool isFieldVchar(unsigned char c) {
+  return is(c, ccFieldVchar);
+}
+
+/* Is this a field-vchar or whitespace?
+ * @c The character to check.
+ *
+ * @return 'true' if `c` matches the `fieldVcharWS` class.
+ */
+static inline bool isFieldVcharWS(unsigned char c) {
+  return is(c, ccFieldVcharWS);
+}
+
+/* Is this a valid token?
+ * @text The text to check.
+ *
+ * @return 'true' if all of `text` matches `token`.
+ */
+static inline bool validToken(const stringView &text) {
+  return !text.empty() && allOf(text, ccTchar);
+}
+
+/* Is this valid field text?
+ * @text The text to check.
+ *
+ * Field text is what's in field content or a reason phrase: anything but
+ * control characters, except for tabs. Header values make up most of a header
+ * block, so this uses the vectorised scanner to check a whole block of
+ * characters at a time.
+ *
+ * @return 'true' if all of `text` matches `fieldVcharWS`.
+ */
+static inline bool validFieldText(const stringView &text) {
+  return scan::findControl(text) == stringView::npos;
+}
+
+/* Is this valid field content?
+ * @text The text to check.
+ *
+ * @return 'true' if all of `text` matches `fieldContent`.
+ */
+static inline bool validFieldContent(const stringView &text) {
+  return !text.empty() && isFieldVchar(text.front()) && validFieldText(text);
+}
+
+/* Is this a valid reason phrase?
+ * @text The text to check.
+ *
+ * @return 'true' if all of `text` matches `reasonPhrase`.
+ */
+static inline bool validReasonPhrase(const stringView &text) {
+  return validFieldText(text);
+}
+
+/* Is this a valid quoted string?
+ * @text The text to check.
+ *
+ * @return 'true' if all of `text` matches `quotedString`.
+ */
+static inline bool validQuotedString(const stringView &text) {
+  if (text.size() < 2 || text.front() != '"' || text.back() != '"') {
+    return false;
+  }
+  for (std::size_t i = 1; i < text.size() - 1; i++) {
+    if (text[i] == '\\') {
+      i++;
+      if (i >= text.size() - 1 || !isFieldVcharWS(text[i])) {
+        return false;
+      }
+    } else if (!isQdtext(text[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Is this an HTTP version?
+ * @text The text to check.
+ *
+ * @return 'true' if all of `text` matches `httpVersion`.
+ */
+static inline bool isHttpVersion(const stringView &text) {
+  return text.size() == 8 && text.startsWith(httpName + "/") &&
+         isDigit(text[5]) && text[6] == '.' && isDigit(text[7]);
+}
+
+/* Remove line terminator.
+ * @line The line to look at.
+ *
+ * Lines may end in a CRLF, or in just one of the two. This is the trailing
+ * "\r?\n?" in all of our line-based productions.
+ *
+ * @return `line`, but without its terminator.
+ */
+static inline stringView stripNewline(stringView line) {
+  if (!line.empty() && line.back() == '\n') {
+    line.removeSuffix(1);
+  }
+  if (!line.empty() && line.back() == '\r') {
+    line.removeSuffix(1);
+  }
+  return line;
+}
 }
 }
 }
@@ -2,7 +2,8 @@
  *
  * The headers data type is a basic map, but with a case-insensitive comparator,
  * which is necessary for processing HTTP/1.1 headers as this makes keys that
- * only differ in their case work as expected.
+ * only differ in their case work as expected. Commonly used headers have fixed
+ * IDs, which makes looking them up a bit quicker.
  *
  * See also:
  * * Project Documentation: https://ef.gy/documentation/cxxhttp
@@ -16,22 +17,383 @@
 #if !defined(CXXHTTP_HTTP_HEADER_H)
 #define CXXHTTP_HTTP_HEADER_H
 
-#include <map>
-#include <regex>
+#include <algorithm>
+#include <array>
+#include <initializer_list>
 #include <set>
+#include <utility>
+#include <vector>
 
 #include <cxxhttp/http-grammar.h>
+#include <cxxhttp/scan.h>
 #include <cxxhttp/string.h>
 
 namespace cxxhttp {
 namespace http {
+/* Well-known header fields.
+ *
+ * Headers that the library itself looks at, or that show up in just about every
+ * request or reply, have a fixed ID. A `headers` instance keeps a slot for each
+ * of these, so looking them up does not need to search the whole map.
+ */
+enum headerField : unsigned char {
+  hfAccept,
+  hfAcceptCharset,
+  hfAcceptEncoding,
+  hfAcceptLanguage,
+  hfAllow,
+  hfAuthorization,
+  hfCacheControl,
+  hfConnection,
+  hfContentEncoding,
+  hfContentLength,
+  hfContentType,
+  hfCookie,
+  hfDate,
+  hfExpect,
+  hfHost,
+  hfLocation,
+  hfServer,
+  hfTransferEncoding,
+  hfUserAgent,
+  hfVary,
+  /* Anything else; also the number of well-known fields. */
+  hfUnknown,
+};
+
+/* Well-known header name.
+ *
+ * An entry in the table of well-known header fields, with the name's hash
+ * already worked out.
+ */
+struct wellKnownHeader {
+  /* The header's name, in its canonical spelling. */
+  const char *name;
+
+  /* caseInsensitiveHash of the name. */
+  std::size_t hash;
+};
+
+/* Well-known header names.
+ *
+ * Must be in the same order as the headerField enum.
+ */
+static constexpr wellKnownHeader wellKnownHeaders[hfUnknown]{
+    {"Accept", caseInsensitiveHash::hash("Accept")},
+    {"Accept-Charset", caseInsensitiveHash::hash("Accept-Charset")},
+    {"Accept-Encoding", caseInsensitiveHash::hash("Accept-Encoding")},
+    {"Accept-Language", caseInsensitiveHash::hash("Accept-Language")},
+    {"Allow", caseInsensitiveHash::hash("Allow")},
+    {"Authorization", caseInsensitiveHash::hash("Authorization")},
+    {"Cache-Control", caseInsensitiveHash::hash("Cache-Control")},
+    {"Connection", caseInsensitiveHash::hash("Connection")},
+    {"Content-Encoding", caseInsensitiveHash::hash("Content-Encoding")},
+    {"Content-Length", caseInsensitiveHash::hash("Content-Length")},
+    {"Content-Type", caseInsensitiveHash::hash("Content-Type")},
+    {"Cookie", caseInsensitiveHash::hash("Cookie")},
+    {"Date", caseInsensitiveHash::hash("Date")},
+    {"Expect", caseInsensitiveHash::hash("Expect")},
+    {"Host", caseInsensitiveHash::hash("Host")},
+    {"Location", caseInsensitiveHash::hash("Location")},
+    {"Server", caseInsensitiveHash::hash("Server")},
+    {"Transfer-Encoding", caseInsensitiveHash::hash("Transfer-Encoding")},
+    {"User-Agent", caseInsensitiveHash::hash("User-Agent")},
+    {"Vary", caseInsensitiveHash::hash("Vary")},
+};
+
+/* Identify a header field.
+ * @name The name of the header.
+ *
+ * Hashes the name once and compares that to the hashes of the well-known
+ * names; only the name with the same hash, if any, is then compared in full.
+ *
+ * @return The ID of the header, or hfUnknown if it isn't a well-known header.
+ */
+static inline headerField identify(const stringView &name) {
+  const std::size_t hash = caseInsensitiveHash()(name);
+  for (unsigned i = 0; i < hfUnknown; i++) {
+    if (wellKnownHeaders[i].hash == hash &&
+        caseInsensitiveEQ()(name, wellKnownHeaders[i].name)) {
+      return headerField(i);
+    }
+  }
+  return hfUnknown;
+}
+
 /* HTTP header type.
  *
- * This is a basic string-to-string map, but with the case-insensitive
- * comparison operator. Usage is the same as any other map, except that keys are
- * effectively considered the same if they only differ in their case.
+ * Works like a std::map of strings to strings, with a case-insensitive
+ * comparator, so keys are effectively considered the same if they only differ
+ * in their case. Iterating over the headers produces them in the same order as
+ * with such a map.
+ *
+ * Headers are kept in a single sorted vector rather than a tree, so there's a
+ * lot less allocating going on, and the well-known headers have a slot that
+ * points right at their entry. Keys must not be modified through an iterator.
  */
-using headers = std::map<std::string, std::string, caseInsensitiveLT>;
+class headers {
+ public:
+  /* Header field type; a name and a value. */
+  using value_type = std::pair<std::string, std::string>;
+
+  /* Header container type. */
+  using container = std::vector<value_type>;
+
+  /* Header iterator. */
+  using iterator = container::iterator;
+
+  /* Constant header iterator. */
+  using const_iterator = container::const_iterator;
+
+  /* Size type. */
+  using size_type = container::size_type;
+
+  /* Construct empty header map. */
+  headers(void) { slot.fill(none); }
+
+  /* Construct with header fields.
+   * @fields The header fields to add.
+   *
+   * If a name shows up more than once, only the first value is used, same as
+   * when initialising a std::map.
+   */
+  headers(std::initializer_list<value_type> fields) : headers() {
+    insert(fields.begin(), fields.end());
+  }
+
+  /* Start of the header fields.
+   *
+   * @return An iterator to the first header field.
+   */
+  iterator begin(void) { return fields.begin(); }
+
+  /* End of the header fields.
+   *
+   * @return An iterator past the last header field.
+   */
+  iterator end(void) { return fields.end(); }
+
+  /* Start of the header fields.
+   *
+   * @return An iterator to the first header field.
+   */
+  const_iterator begin(void) const { return fields.begin(); }
+
+  /* End of the header fields.
+   *
+   * @return An iterator past the last header field.
+   */
+  const_iterator end(void) const { return fields.end(); }
+
+  /* Are there any header fields?
+   *
+   * @return 'true' if there are no header fields.
+   */
+  bool empty(void) const { return fields.empty(); }
+
+  /* Number of header fields.
+   *
+   * @return The number of header fields.
+   */
+  size_type size(void) const { return fields.size(); }
+
+  /* Remove all header fields. */
+  void clear(void) {
+    fields.clear();
+    slot.fill(none);
+  }
+
+  /* Find a header field.
+   * @name The name of the header to look for.
+   *
+   * @return An iterator to the header field, or end() if it isn't set.
+   */
+  iterator find(const std::string &name) {
+    return begin() + position(name, identify(name));
+  }
+
+  /* Find a header field.
+   * @name The name of the header to look for.
+   *
+   * @return An iterator to the header field, or end() if it isn't set.
+   */
+  const_iterator find(const std::string &name) const {
+    return begin() + position(name, identify(name));
+  }
+
+  /* Find a well-known header field.
+   * @id The ID of the header to look for.
+   *
+   * @return An iterator to the header field, or end() if it isn't set.
+   */
+  const_iterator find(headerField id) const {
+    return slot[id] == none ? end() : begin() + slot[id];
+  }
+
+  /* Count header fields.
+   * @name The name of the header to look for.
+   *
+   * @return 1 if the header is set, 0 otherwise.
+   */
+  size_type count(const std::string &name) const {
+    return find(name) == end() ? 0 : 1;
+  }
+
+  /* Access header field value.
+   * @name The name of the header.
+   *
+   * Adds the header with an empty value if it isn't set yet.
+   *
+   * @return A reference to the header's value.
+   */
+  std::string &operator[](const std::string &name) {
+    const headerField id = identify(name);
+    if (id != hfUnknown && slot[id] != none) {
+      return fields[slot[id]].second;
+    }
+    const size_type p = lowerBound(name);
+    if (p == fields.size() || !caseInsensitiveEQ()(name, fields[p].first)) {
+      place(p, id, value_type(name, ""));
+    }
+    return fields[p].second;
+  }
+
+  /* Insert a header field.
+   * @field The name and value of the header.
+   *
+   * Does not overwrite the value if the header is already set.
+   *
+   * @return An iterator to the header field with the same name as `field`, and
+   * whether `field` was inserted.
+   */
+  std::pair<iterator, bool> insert(const value_type &field) {
+    const headerField id = identify(field.first);
+    if (id != hfUnknown && slot[id] != none) {
+      return {begin() + slot[id], false};
+    }
+    const size_type p = lowerBound(field.first);
+    if (p < fields.size() &&
+        caseInsensitiveEQ()(field.first, fields[p].first)) {
+      return {begin() + p, false};
+    }
+    place(p, id, field);
+    return {begin() + p, true};
+  }
+
+  /* Insert header fields.
+   * @first The first header field to insert.
+   * @last Past the last header field to insert.
+   *
+   * Headers that are already set are not overwritten.
+   */
+  template <class inputIterator>
+  void insert(inputIterator first, inputIterator last) {
+    for (; first != last; first++) {
+      insert(*first);
+    }
+  }
+
+  /* Remove a header field.
+   * @name The name of the header to remove.
+   *
+   * @return The number of header fields that were removed.
+   */
+  size_type erase(const std::string &name) {
+    const headerField id = identify(name);
+    const size_type p = position(name, id);
+    if (p == fields.size()) {
+      return 0;
+    }
+    fields.erase(fields.begin() + p);
+    for (auto &s : slot) {
+      if (s != none && s > p) {
+        s--;
+      }
+    }
+    if (id != hfUnknown) {
+      slot[id] = none;
+    }
+    return 1;
+  }
+
+  /* Equality operator.
+   * @b The header map to compare to.
+   *
+   * Like with a std::map, names and values are compared as they are, so two
+   * maps with the same headers, but in different case, are not equal.
+   *
+   * @return 'true' if both maps have the same header fields.
+   */
+  bool operator==(const headers &b) const { return fields == b.fields; }
+
+  /* Inequality operator.
+   * @b The header map to compare to.
+   *
+   * @return 'false' if both maps have the same header fields.
+   */
+  bool operator!=(const headers &b) const { return fields != b.fields; }
+
+ protected:
+  /* Marks an empty slot. */
+  enum : size_type { none = ~size_type(0) };
+
+  /* Header fields, sorted by name. */
+  container fields;
+
+  /* Positions of well-known header fields, or `none` if not set. */
+  std::array<size_type, hfUnknown> slot;
+
+  /* Find first header field not before a name.
+   * @name The header name to look for.
+   *
+   * @return Position of the first header field that is not less than `name`.
+   */
+  size_type lowerBound(const std::string &name) const {
+    return std::lower_bound(fields.begin(), fields.end(), name,
+                            [](const value_type &f, const std::string &n) {
+                              return caseInsensitiveLT()(f.first, n);
+                            }) -
+           fields.begin();
+  }
+
+  /* Find position of a header field.
+   * @name The header name to look for.
+   * @id The ID of `name`, as determined with identify().
+   *
+   * @return Position of the header field, or the number of fields if it isn't
+   * set.
+   */
+  size_type position(const std::string &name, headerField id) const {
+    if (id != hfUnknown) {
+      return slot[id] == none ? fields.size() : slot[id];
+    }
+    const size_type p = lowerBound(name);
+    if (p < fields.size() && caseInsensitiveEQ()(name, fields[p].first)) {
+      return p;
+    }
+    return fields.size();
+  }
+
+  /* Add a header field.
+   * @p Where to put the new header field.
+   * @id The ID of the new header field's name.
+   * @field The new header field.
+   *
+   * Moves the header fields after `p` out of the way and updates the slots to
+   * match.
+   */
+  void place(size_type p, headerField id, const value_type &field) {
+    fields.insert(fields.begin() + p, field);
+    for (auto &s : slot) {
+      if (s != none && s >= p) {
+        s++;
+      }
+    }
+    if (id != hfUnknown) {
+      slot[id] = p;
+    }
+  }
+};
 
 /* Header parser functionality.
  * @headers The map-like type to use when parsing headers.
@@ -100,49 +462,43 @@ class parser {
    * @line The raw line to parse and absorb.
    *
    * Parse a header line using MIME header rules, and append any keys or values
-   * to the header instance.
+   * to the header instance. The line is scanned in place, so this works just as
+   * well on a line that is still sitting in an input buffer.
    *
    * @return 'true' if the line was successfully parsed as a header.
    */
-  bool absorb(const std::string &line) {
-    static const std::string captureName = "(" + grammar::fieldName + ")";
-    static const std::string captureValue = "(" + grammar::fieldContent + ")?";
+  bool absorb(const stringView &line) {
+    const stringView l = grammar::stripNewline(line);
 
-    static const std::regex headerProper(captureName + ":" + grammar::ows +
-                                         captureValue + grammar::ows +
-                                         "\r?\n?");
-    static const std::regex headerContinued(grammar::rws + captureValue +
-                                            grammar::ows + "\r?\n?");
-    static const std::regex finalLine("\r?\n?");
-
-    bool matched = std::regex_match(line, finalLine);
+    bool matched = l.empty();
     complete = matched;
 
     if (!complete) {
-      std::smatch matches;
+      stringView value;
 
-      matched = !lastHeader.empty() &&
-                std::regex_match(line, matches, headerContinued);
-      std::string appendValue;
+      matched = !lastHeader.empty() && grammar::isWhitespace(l[0]) &&
+                fieldValue(l, value);
       bool lws = matched;
 
-      if (matched) {
-        appendValue = matches[1];
-      } else {
-        matched = std::regex_match(line, matches, headerProper);
+      if (!matched) {
+        const std::size_t n = scan::find(l, ':');
 
-        if (matched) {
-          lastHeader = matches[1];
+        matched = n != stringView::npos &&
+                  grammar::validToken(l.substr(0, n)) &&
+                  fieldValue(l.substr(n + 1), value);
 
-          // RFC 2616, section 4.2:
-          // Header fields that occur multiple times must be combinable into a
-          // single value by appending the fields in the order they occur, using
-          // commas to separate the individual values.
-          appendValue = matches[2];
+        if (matched) {
+          lastHeader = l.substr(0, n);
         }
       }
 
-      append(lastHeader, appendValue, lws);
+      // RFC 2616, section 4.2:
+      // Header fields that occur multiple times must be combinable into a
+      // single value by appending the fields in the order they occur, using
+      // commas to separate the individual values.
+      if (matched) {
+        append(lastHeader, value, lws);
+      }
     }
 
     return matched;
@@ -151,7 +507,7 @@ class parser {
   /* Insert a different header map.
    * @map The map to merge in.
    *
-   * Merges headers with the given new map. This uses std::map::insert(), which
+   * Merges headers with the given new map. This uses headers::insert(), which
    * will not overwrite values that already but instead only insert elements
    * that don't exist yet.
    */
@@ -171,6 +527,29 @@ class parser {
     }
     return r;
   }
+
+ protected:
+  /* Extract a field value.
+   * @text Everything after the colon, or a continuation line.
+   * @value Set to the field content, without surrounding whitespace.
+   *
+   * This is the "OWS field-value OWS" part of a header field.
+   *
+   * @return 'true' if `text` only contains valid field content.
+   */
+  static bool fieldValue(stringView text, stringView &value) {
+    while (!text.empty() && grammar::isWhitespace(text.front())) {
+      text.removePrefix(1);
+    }
+    while (!text.empty() && grammar::isWhitespace(text.back())) {
+      text.removeSuffix(1);
+    }
+    if (!grammar::validFieldText(text)) {
+      return false;
+    }
+    value = text;
+    return true;
+  }
 };
 }
 }
@@ -0,0 +1,136 @@
+/* HTTP message buffers.
+ *
+ * Outbound messages are kept as a header block and a separate body, which are
+ * then written with a single gather write. That way the body, which could be
+ * rather large, doesn't need to be copied into yet another string just to put
+ * the headers in front of it. Several messages can also be sent with the same
+ * write.
+ *
+ * See also:
+ * * Project Documentation: https://ef.gy/documentation/cxxhttp
+ * * Project Source Code: https://github.com/ef-gy/cxxhttp
+ * * Licence Terms: https://github.com/ef-gy/cxxhttp/blob/master/COPYING
+ *
+ * @copyright
+ * This file is part of the cxxhttp project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ */
+#if !defined(CXXHTTP_HTTP_MESSAGE_H)
+#define CXXHTTP_HTTP_MESSAGE_H
+
+#include <array>
+#include <list>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <asio.hpp>
+
+namespace cxxhttp {
+namespace http {
+/* An outbound HTTP message.
+ *
+ * The start line and headers, including the empty line at the end of the
+ * header block, and the message body, if there is one. The body is shared, so
+ * copies of a message don't copy the body.
+ */
+class message {
+ public:
+  /* Start line and header block. */
+  std::string header;
+
+  /* Message body; may be null if there is no body. */
+  std::shared_ptr<const std::string> body;
+
+  /* Construct empty message. */
+  message(void) {}
+
+  /* Construct with header block and body.
+   * @pHeader The start line and header block.
+   * @pBody The message body, if any.
+   */
+  message(std::string pHeader, std::shared_ptr<const std::string> pBody = {})
+      : header(std::move(pHeader)), body(std::move(pBody)) {}
+
+  /* Message size.
+   *
+   * @return The number of bytes needed to send the message.
+   */
+  std::size_t size(void) const {
+    return header.size() + (body ? body->size() : 0);
+  }
+
+  /* Buffers to write.
+   *
+   * The buffers refer to the message's own data, so they're only valid for as
+   * long as the message is. The second buffer is empty if there is no body.
+   *
+   * @return Buffers for the header block and the body, in that order.
+   */
+  std::array<asio::const_buffer, 2> buffers(void) const {
+    return {{asio::buffer(header),
+             body ? asio::buffer(*body) : asio::const_buffer()}};
+  }
+
+  /* Flatten message.
+   *
+   * Copies the whole message into a single string. Not used when sending the
+   * message, but useful for tests and debugging.
+   *
+   * @return The message, as it would be sent.
+   */
+  operator std::string(void) const { return header + (body ? *body : ""); }
+};
+
+/* Gather messages for a single write.
+ * @queue The messages waiting to be sent.
+ * @batch Messages are moved here from the front of `queue`.
+ * @buffers Gets the buffers for all the messages that were moved.
+ * @maxBytes Stop before the messages would add up to more bytes than this.
+ * @maxBuffers Stop before needing more buffers than this.
+ *
+ * Takes as many messages as it can off the front of `queue`, without going
+ * over either of the limits. The first message is always taken, even if it's
+ * too big by itself, so that it can be sent at all. Empty header blocks or
+ * bodies don't need a buffer.
+ *
+ * The messages in `batch` must be kept around until `buffers` have been
+ * written, as the buffers refer to the messages' data.
+ *
+ * @return The number of messages that were moved to `batch`.
+ */
+static inline std::size_t gather(std::list<message> &queue,
+                                 std::list<message> &batch,
+                                 std::vector<asio::const_buffer> &buffers,
+                                 std::size_t maxBytes, std::size_t maxBuffers) {
+  std::size_t bytes = 0;
+  std::size_t count = 0;
+
+  while (queue.size() > 0) {
+    const message &m = queue.front();
+    const bool header = !m.header.empty();
+    const bool body = m.body && !m.body->empty();
+    if (count > 0 && (bytes + m.size() > maxBytes ||
+                      buffers.size() + header + body > maxBuffers)) {
+      break;
+    }
+
+    if (header) {
+      buffers.push_back(asio::buffer(m.header));
+    }
+    if (body) {
+      buffers.push_back(asio::buffer(*m.body));
+    }
+    bytes += m.size();
+    count++;
+
+    batch.splice(batch.end(), queue, queue.begin());
+  }
+
+  return count;
+}
+}
+}
+
+#endif
@@ -91,7 +91,22 @@ class session : public sessionData {
       : connection(pConnection),
         flow(connection.processor, connection.io, *this),
         socket(flow.inputConnection),
-        beacon(*this, connection.sessions) {}
+        beacon(*this, connection.sessions) {
+    flow.released = [this] {
+      if (!connection.release(this)) {
+        // the pool is full, so delete the session instead - but only after
+        // the handler that released it is done with it.
+        flow.strand.post([this] { connection.discard(this); });
+      }
+    };
+  }
+
+  /* Destructor.
+   *
+   * Keeps the flow from handing the session back to the connection while it's
+   * being destroyed.
+   */
+  ~session(void) { flow.released = nullptr; }
 
   /* Start processing.
    *
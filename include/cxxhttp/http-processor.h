@@ -17,12 +17,16 @@
 #include <algorithm>
 #include <functional>
 #include <list>
+#include <memory>
 
 #include <cxxhttp/negotiate.h>
 #include <cxxhttp/network.h>
+#include <cxxhttp/workers.h>
 
 #include <cxxhttp/http-constants.h>
+#include <cxxhttp/http-deferred.h>
 #include <cxxhttp/http-error.h>
+#include <cxxhttp/http-router.h>
 #include <cxxhttp/http-servlet.h>
 #include <cxxhttp/http-session.h>
 
@@ -30,14 +34,6 @@ namespace cxxhttp {
 namespace http {
 template <typename transport, typename requestProcessor>
 class session;
-/* Default servers headers.
- *
- * These headers are sent by default with every server reply, unless overriden.
- */
-static const headers defaultServerHeaders{
-    {"Server", identifier},
-};
-
 /* HTTP processors
  *
  * This namespace is reserved for HTTP "processors", which contain the logic to
@@ -74,6 +70,26 @@ class server {
    */
   efgy::beacons<http::servlet> servlets;
 
+  /* Routing index.
+   *
+   * Compiles the resource regexen of <servlets> into a single automaton, or
+   * indexes them by their literal prefixes. Updated as needed whenever a
+   * request is handled. Set its `cacheSize` to cache the servlets that match
+   * the most recently requested resources.
+   *
+   * The index does its own locking, so requests on different threads can use
+   * it at the same time.
+   */
+  mutable router routes;
+
+  /* Worker pool.
+   *
+   * Handlers of servlets that are marked as blocking are run on this pool.
+   * Defaults to the global pool, which the `workers` and `worker-queue` CLI
+   * options configure.
+   */
+  workers *pool = &efgy::global<workers>();
+
   /* Handle request
    * @sess The session object where the request was made.
    *
@@ -81,72 +97,20 @@ class server {
    * to be handled, this will go through the registered list of regexen, and for
    * all that match it will call the registered function, until one of them
    * returns and has sent a response.
+   *
+   * The servlets whose resource regex matches are found with <routes>, which
+   * only runs the regexen that could match at all, if any.
    */
   void handle(sessionData &sess) const {
-    std::set<std::string> methods;
-    bool badNegotiation = false;
-    bool methodSupported = false;
-
     const std::string resource = sess.inboundRequest.resource.path();
-    const std::string resourceAndQuery = sess.inboundRequest.resource.path() +
-                                         "?" +
-                                         sess.inboundRequest.resource.query();
-    const std::string method = sess.inboundRequest.method;
-    sess.isHEAD = method == "HEAD";
-
-    for (const auto &servlet : servlets) {
-      std::smatch matches;
-
-      bool resourceMatch =
-          std::regex_match(resource, matches, servlet->resource) ||
-          std::regex_match(resourceAndQuery, matches, servlet->resource);
-      bool methodMatch = std::regex_match(method, servlet->method);
-
-      if (!methodMatch && sess.isHEAD) {
-        methodMatch = std::regex_match("GET", servlet->method);
-      }
-
-      methodSupported = methodSupported || methodMatch;
-
-      if (resourceMatch) {
-        if (methodMatch) {
-          sess.outbound = {defaultServerHeaders};
-          badNegotiation =
-              badNegotiation || !sess.negotiate(servlet->negotiations);
-
-          if (!badNegotiation) {
-            const std::size_t q = sess.queries();
-            servlet->handler(sess, matches);
-
-            if (sess.queries() > q) {
-              // we've sent something back to the client, so no need to process
-              // any further.
-              return;
-            }
-          }
+    sess.isHEAD = sess.inboundRequest.method == "HEAD";
 
-          methods.insert(method);
-        } else
-          for (const auto &m : http::method) {
-            if (std::regex_match(m, servlet->method)) {
-              methods.insert(m);
-            }
-          }
-      }
-    }
+    lookup l;
+    l.generation = servlet::generation();
+    routes.update(servlets);
+    l.resolved = routes.resolve(resource, sess.inboundRequest.resource.query());
 
-    error e(sess);
-
-    if (!methodSupported) {
-      e.reply(501);
-    } else if (badNegotiation) {
-      e.reply(406);
-    } else if (sess.trigger405(methods)) {
-      e.allow = methods;
-      e.reply(405);
-    } else {
-      e.reply(404);
-    }
+    dispatch(sess, l);
   }
 
   /* Decide whether to expect content or not.
@@ -158,8 +122,8 @@ class server {
    * @return The parser state to switch to.
    */
   enum status afterHeaders(sessionData &sess) const {
-    const auto &cli = sess.inbound.header.find("Content-Length");
-    const auto &exp = sess.inbound.header.find("Expect");
+    const auto &cli = sess.inbound.header.find(hfContentLength);
+    const auto &exp = sess.inbound.header.find(hfExpect);
 
     if (exp != sess.inbound.header.end()) {
       if (exp->second == "100-continue") {
@@ -226,6 +190,208 @@ class server {
    * There's nothing to do here for the server, so we just don't do anything.
    */
   void recycle(sessionData &sess) {}
+
+ protected:
+  /* State of a request's dispatch.
+   *
+   * Everything dispatch() needs to know to carry on with the servlets that
+   * come after one that was run on the worker pool.
+   */
+  struct lookup {
+    /* The servlets that match the resource. */
+    std::shared_ptr<const resolution> resolved;
+
+    /* Position of the next servlet to try in <resolved>. */
+    std::size_t next = 0;
+
+    /* Methods that servlets allow, but that methodBit() doesn't know. */
+    std::set<std::string> methods;
+
+    /* Known methods that servlets allow. */
+    methodMask allowed = 0;
+
+    /* Whether content negotiation failed for any of the servlets. */
+    bool badNegotiation = false;
+
+    /* The servlet::generation() that <resolved> is for. */
+    std::size_t generation = 0;
+
+    /* Servlets in <resolved> that were already tried with an earlier
+     * resolution; only compared, as they may be gone. */
+    std::vector<const servlet *> tried;
+  };
+
+  /* Try servlets until one of them replies.
+   * @sess The session object where the request was made.
+   * @l Which servlets to try, and what came of those tried so far.
+   *
+   * Runs the handlers of the servlets in `l`, starting with the next one, until
+   * one of them replies. If none of them do, an appropriate error is sent.
+   *
+   * Handlers of blocking servlets are run on the worker pool, in which case the
+   * request is deferred, and this carries on from the next servlet once the
+   * handler is done, if it didn't reply. Other handlers may defer their reply
+   * with an http::deferred token, which also counts as a reply here.
+   */
+  void dispatch(sessionData &sess, lookup &l) const {
+    const std::string &method = sess.inboundRequest.method;
+    const methodMask bit = methodBit(method);
+    const methodMask mask = bit | (sess.isHEAD ? methodBit("GET") : 0);
+
+    while (l.next < l.resolved->servlets.size()) {
+      const auto &match = l.resolved->servlets[l.next++];
+      const auto &servlet = match.first;
+      std::smatch matches = match.second;
+
+      if (!l.tried.empty() &&
+          std::find(l.tried.begin(), l.tried.end(), servlet) != l.tried.end()) {
+        continue;
+      }
+
+      if (servlet->allows(method, mask)) {
+        sess.outbound = {defaultServerHeaders};
+        l.badNegotiation =
+            l.badNegotiation || !sess.negotiate(servlet->negotiators);
+
+        if (!l.badNegotiation) {
+          const std::size_t q = sess.queries();
+
+          if (servlet->blocking && sess.resume) {
+            offload(sess, l, servlet, matches);
+            return;
+          }
+
+          servlet->handler(sess, matches);
+
+          if (sess.queries() > q || sess.status == stDeferred) {
+            // we've sent something back to the client, or will do so later,
+            // so no need to process any further.
+            return;
+          }
+        }
+
+        if (bit != 0) {
+          l.allowed |= bit;
+        } else {
+          l.methods.insert(method);
+        }
+      } else {
+        l.allowed |= servlet->methods;
+      }
+    }
+
+    const auto known = methodNames(l.allowed);
+    l.methods.insert(known.begin(), known.end());
+
+    error e(sess);
+
+    if (!methodSupported(method, mask)) {
+      e.reply(501);
+    } else if (l.badNegotiation) {
+      e.reply(406);
+    } else if (sess.trigger405(l.methods)) {
+      e.allow = l.methods;
+      e.reply(405);
+    } else {
+      e.reply(404);
+    }
+  }
+
+  /* Run a blocking servlet's handler on the worker pool.
+   * @sess The session object where the request was made.
+   * @l The state of the request's dispatch.
+   * @servlet The servlet to run the handler of.
+   * @matches The servlet's resource regex matches.
+   *
+   * Defers the request until the handler is done. If it didn't reply, the
+   * remaining servlets are tried with dispatch(), back on the session's own
+   * strand. If the pool's queue is full, this replies with a 503 right away.
+   *
+   * Servlets may come and go before the worker gets to the handler, so the
+   * job holds on to the servlet's lifetime, and only runs the handler if the
+   * servlet is still around. If any servlets came or went, the request is
+   * resolved again before trying the remaining ones; see reroute().
+   */
+  void offload(sessionData &sess, lookup &l, const servlet *servlet,
+               const std::smatch &matches) const {
+    const std::size_t q = sess.queries();
+    auto state = std::make_shared<lookup>(l);
+    const auto life = servlet->life;
+
+    sess.status = stDeferred;
+    const bool queued =
+        pool->submit([this, &sess, state, servlet, life, matches, q] {
+          const bool ran = life->enter();
+          if (ran) {
+            std::smatch m = matches;
+            servlet->handler(sess, m);
+            life->leave();
+          }
+
+          sess.resume([this, &sess, state, q, ran] {
+            if (sess.queries() > q) {
+              return;
+            }
+
+            // if the servlet is gone, it doesn't allow the method anymore.
+            const methodMask bit = methodBit(sess.inboundRequest.method);
+            if (ran && bit != 0) {
+              state->allowed |= bit;
+            } else if (ran) {
+              state->methods.insert(sess.inboundRequest.method);
+            }
+            if (state->generation != servlet::generation()) {
+              reroute(sess, *state);
+            }
+            dispatch(sess, *state);
+          });
+        });
+
+    if (!queued) {
+      sess.status = stProcessing;
+      error(sess).reply(503);
+    }
+  }
+
+  /* Resolve a request again.
+   * @sess The session object where the request was made.
+   * @l The state of the request's dispatch.
+   *
+   * For when servlets came or went while the request was deferred, so that
+   * `l` may refer to servlets that are gone. Gets a new resolution for the
+   * request, and remembers the servlets that were already tried with the old
+   * one, so dispatch() can skip them.
+   */
+  void reroute(sessionData &sess, lookup &l) const {
+    for (std::size_t i = 0; i < l.next; i++) {
+      l.tried.push_back(l.resolved->servlets[i].first);
+    }
+
+    l.generation = servlet::generation();
+    routes.update(servlets);
+    l.resolved = routes.resolve(sess.inboundRequest.resource.path(),
+                                sess.inboundRequest.resource.query());
+    l.next = 0;
+  }
+
+  /* Is a method supported at all?
+   * @method The request method.
+   * @mask The request method's bit, including GET for HEAD requests.
+   *
+   * Looks at all servlets, not just the ones that the router found for the
+   * request, so this is only used when no servlet replied.
+   *
+   * @return 'true' if any servlet accepts `method`.
+   */
+  bool methodSupported(const std::string &method, methodMask mask) const {
+    std::lock_guard<std::mutex> guard(servlet::setLock());
+    for (const auto &servlet : servlets) {
+      if (servlet->allows(method, mask)) {
+        return true;
+      }
+    }
+    return false;
+  }
 };
 
 /* Client request data.
@@ -326,7 +492,7 @@ class client {
       // what GET would return.
       sess.contentLength = 0;
     } else {
-      const auto &cli = sess.inbound.header.find("Content-Length");
+      const auto &cli = sess.inbound.header.find(hfContentLength);
 
       if (cli != sess.inbound.header.end()) {
         try {
@@ -14,9 +14,8 @@
 #if !defined(CXXHTTP_HTTP_REQUEST_H)
 #define CXXHTTP_HTTP_REQUEST_H
 
-#include <regex>
-
 #include <cxxhttp/http-grammar.h>
+#include <cxxhttp/scan.h>
 #include <cxxhttp/uri.h>
 #include <cxxhttp/http-version.h>
 
@@ -60,19 +59,42 @@ class requestLine {
    * This currently only accepts >= HTTP/0.9 request lines, all others will be
    * rejected.
    */
-  requestLine(const std::string &line) {
-    static const std::regex req("(\\w+) ([\\w\\d%/.:;()+?=&-]+|\\*) " +
-                                grammar::httpVersion + "\r?\n?");
-    std::smatch matches;
-    bool matched = std::regex_match(line, matches, req);
-
-    if (matched) {
-      method = matches[1];
-      resource = std::string(matches[2]);
-      const std::string maj = matches[3];
-      const std::string min = matches[4];
-      version = {maj, min};
+  requestLine(const std::string &line) : requestLine(stringView(line)) {}
+
+  /* Parse HTTP request line in place.
+   * @line The (suspected) request line to parse.
+   *
+   * Scans the line directly, so that the flow control can hand us a line that
+   * is still in its input buffer. Only the method and resource are copied, and
+   * only if the whole line turns out to be valid.
+   */
+  requestLine(const stringView &line) {
+    const stringView l = grammar::stripNewline(line);
+
+    const std::size_t m = scan::find(l, ' ');
+    if (m == 0 || m == stringView::npos) {
+      return;
     }
+    const std::size_t e = scan::find(l, ' ', m + 1);
+    if (e == stringView::npos) {
+      return;
+    }
+
+    const stringView name = l.substr(0, m);
+    const stringView target = l.substr(m + 1, e - m - 1);
+    const stringView protocol = l.substr(e + 1);
+    const bool validTarget =
+        target == "*" ||
+        (!target.empty() && grammar::allOf(target, grammar::ccTarget));
+
+    if (!grammar::allOf(name, grammar::ccMethod) || !validTarget ||
+        !grammar::isHttpVersion(protocol)) {
+      return;
+    }
+
+    method = name;
+    resource = std::string(target);
+    version = http::version(protocol);
   }
 
   /* Construct with method and resource.
@@ -124,6 +146,7 @@ class requestLine {
 
     return method + " " + std::string(resource) + " " + protocol() + trailer;
   }
+
 };
 }
 }
@@ -0,0 +1,525 @@
+/* HTTP request routing.
+ *
+ * Finding the servlets that may apply to a request used to mean running every
+ * servlet's resource regex against the request. Most of those regexen are
+ * simple enough to be compiled into a single automaton, which finds all the
+ * servlets that match with one pass over the request.
+ *
+ * For the regexen that the automaton doesn't support, we make use of the fact
+ * that most of them start with a fixed string, like "/api/" or "/robots.txt":
+ * we index those servlets by that string and only run the regexen of the ones
+ * whose prefix actually matches the request.
+ *
+ * See also:
+ * * Project Documentation: https://ef.gy/documentation/cxxhttp
+ * * Project Source Code: https://github.com/ef-gy/cxxhttp
+ * * Licence Terms: https://github.com/ef-gy/cxxhttp/blob/master/COPYING
+ *
+ * @copyright
+ * This file is part of the cxxhttp project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ */
+#if !defined(CXXHTTP_HTTP_ROUTER_H)
+#define CXXHTTP_HTTP_ROUTER_H
+
+#include <algorithm>
+#include <cctype>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <regex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <cxxhttp/automaton.h>
+#include <cxxhttp/http-servlet.h>
+
+namespace cxxhttp {
+namespace http {
+/* Literal part of a regex.
+ *
+ * The result of analysing a regex with literalPrefix(): the fixed string that
+ * anything matching the regex must start with, and whether that is all the
+ * regex would match.
+ */
+struct literal {
+  /* Fixed prefix of any string the regex matches; may be empty. */
+  std::string prefix;
+
+  /* Whether the regex only matches `prefix` itself. */
+  bool exact;
+};
+
+/* Find the literal prefix of a regex.
+ * @regex An ECMAScript regex, as used for servlet resources.
+ *
+ * Reads the regex from the start for as long as it only contains plain or
+ * escaped characters. Anything fancier, like a group, a character class or a
+ * quantifier, ends the prefix; a quantifier also takes the character before it
+ * out of the prefix. A regex with an alternative at the top level, like
+ * "^\*|/.*", has no usable prefix at all.
+ *
+ * This errs on the side of a shorter prefix; the regex still has to match, so
+ * a prefix that is too short only costs time.
+ *
+ * @return The literal prefix of the regex.
+ */
+static inline literal literalPrefix(const std::string &regex) {
+  // look for top-level alternatives first.
+  std::size_t depth = 0;
+  bool inClass = false;
+  for (std::size_t i = 0; i < regex.size(); i++) {
+    const char c = regex[i];
+    if (c == '\\') {
+      i++;
+    } else if (inClass) {
+      inClass = c != ']';
+    } else if (c == '[') {
+      inClass = true;
+    } else if (c == '(') {
+      depth++;
+    } else if (c == ')' && depth > 0) {
+      depth--;
+    } else if (c == '|' && depth == 0) {
+      return {"", false};
+    }
+  }
+
+  literal r{"", false};
+  std::size_t i = regex.size() > 0 && regex[0] == '^' ? 1 : 0;
+
+  for (; i < regex.size(); i++) {
+    const char c = regex[i];
+    char l;
+
+    if (c == '\\' && i + 1 < regex.size() &&
+        !std::isalnum(static_cast<unsigned char>(regex[i + 1]))) {
+      l = regex[++i];
+    } else if (std::string("\\^$.|?*+()[]{}").find(c) == std::string::npos) {
+      l = c;
+    } else {
+      break;
+    }
+
+    if (i + 1 < regex.size() &&
+        std::string("?*+{").find(regex[i + 1]) != std::string::npos) {
+      // the character is optional or repeated, so it's not part of the prefix
+      // and nothing after it is, either.
+      return r;
+    }
+
+    r.prefix.push_back(l);
+  }
+
+  r.exact = i == regex.size() || (i + 1 == regex.size() && regex[i] == '$');
+  return r;
+}
+
+/* Routing result.
+ *
+ * A servlet that may apply to a request, and whether its resource regex may
+ * match the request's path, or its path and query.
+ */
+struct route {
+  /* The servlet. */
+  servlet *target;
+
+  /* Whether the servlet's regex may match the path. */
+  bool resource;
+
+  /* Whether the servlet's regex may match the path and query. */
+  bool query;
+};
+
+/* Resolved request.
+ *
+ * The servlets whose resource regex matches a request, along with what their
+ * subexpressions matched. The matches refer to this object's copies of the
+ * request's path and query, so they're only valid for as long as it is, and
+ * it must not be copied.
+ */
+struct resolution {
+  /* The request's path. */
+  std::string resource;
+
+  /* The request's path, a question mark and the query.
+   *
+   * Left empty if none of the servlets match the query.
+   */
+  std::string resourceAndQuery;
+
+  /* The matching servlets, in set order, and their subexpression matches. */
+  std::vector<std::pair<servlet *, std::smatch>> servlets;
+};
+
+/* Servlet routing index.
+ *
+ * Compiles the resource regexen of a set of servlets into an automaton, or
+ * indexes them by their literal prefixes, using a trie, for the ones that the
+ * automaton doesn't support. Given a request, it produces the servlets that
+ * may apply to it, in the same order that the servlets appear in the set. That
+ * order matters, as the first servlet to reply wins.
+ *
+ * Resolving requests can also be cached. Most traffic tends to be for only a
+ * few resources, and the cache lets us skip the regexen entirely for those.
+ *
+ * Routers can be used on several threads at once. The index itself is never
+ * changed once it's built, so requests only need to take turns to get hold of
+ * it and to look at the cache, while the automaton and the regexen are run
+ * without holding any locks.
+ */
+class router {
+ public:
+  /* Maximum number of cached resolutions.
+   *
+   * The cache evicts the least recently used resolution once it's full. The
+   * default is 0, which disables the cache.
+   */
+  std::size_t cacheSize = 0;
+
+  /* Number of requests resolved with the cache. */
+  std::size_t hits = 0;
+
+  /* Number of requests that weren't in the cache; only counted while the
+   * cache is enabled. */
+  std::size_t misses = 0;
+
+  /* Construct empty index. */
+  router(void) : current(std::make_shared<table>()) {}
+
+  /* Update index.
+   * @servlets The servlets to index; always the same set.
+   *
+   * Rebuilds the index if any servlet has been created or destroyed since the
+   * last call, which only takes comparing servlet::generation() to what it was
+   * back then.
+   */
+  template <typename set>
+  void update(const set &servlets) {
+    const std::size_t g = servlet::generation();
+    std::lock_guard<std::mutex> guard(lock);
+    if (g != generation) {
+      rebuild(servlets);
+      generation = g;
+    }
+  }
+
+  /* Find servlets for a request.
+   * @resource The request's path.
+   * @resourceAndQuery The request's path, a question mark and the query; or
+   *     empty, to only look at the path.
+   *
+   * Servlets whose regex was compiled into the automaton are only in the
+   * result if their regex does match, and `resource` and `query` say exactly
+   * which of the two strings it matches. For the other servlets we only know
+   * that their regex might match, so both are set. Either way, `query` is
+   * only set for servlets that want to match the query.
+   *
+   * Either way, std::regex_match() still needs to be run on the servlet to
+   * find out what the subexpressions matched.
+   *
+   * @return The servlets that may apply, in set order.
+   */
+  std::vector<route> match(const std::string &resource,
+                           const std::string &resourceAndQuery) const {
+    return index()->match(resource, resourceAndQuery);
+  }
+
+  /* Resolve request.
+   * @resource The request's path.
+   * @query The request's query.
+   *
+   * Runs the regexen of the servlets that match() comes up with, to find the
+   * ones that really match and what their subexpressions matched, or looks up
+   * the result of doing that for an earlier request for the same path and
+   * query. The query is ignored if none of the servlets want to match it.
+   *
+   * @return The servlets that match, with their subexpression matches.
+   */
+  std::shared_ptr<const resolution> resolve(const std::string &resource,
+                                            const std::string &query) {
+    std::shared_ptr<const table> t;
+    std::string key;
+
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      t = current;
+
+      if (cacheSize > 0) {
+        // the path can contain a question mark, so the key needs to say where
+        // the path ends.
+        key = t->anyQuery ? std::to_string(resource.size()) + ":" + resource +
+                                "?" + query
+                          : resource;
+        const auto it = cached.find(key);
+        if (it != cached.end()) {
+          hits++;
+          recent.splice(recent.begin(), recent, it->second);
+          return it->second->second;
+        }
+        misses++;
+      }
+    }
+
+    const auto r = std::make_shared<resolution>();
+    r->resource = resource;
+    if (t->anyQuery) {
+      r->resourceAndQuery = resource + "?" + query;
+    }
+
+    for (const auto &route : t->match(r->resource, r->resourceAndQuery)) {
+      const auto &rx = route.target->resource;
+      std::smatch matches;
+      if ((route.resource && std::regex_match(r->resource, matches, rx)) ||
+          (route.query && std::regex_match(r->resourceAndQuery, matches, rx))) {
+        r->servlets.push_back({route.target, matches});
+      }
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    // only cache the resolution if the index is still the one it came from,
+    // and if nobody else beat us to it.
+    if (cacheSize > 0 && t == current && cached.find(key) == cached.end()) {
+      recent.push_front({key, r});
+      cached[key] = recent.begin();
+      while (recent.size() > cacheSize) {
+        cached.erase(recent.back().first);
+        recent.pop_back();
+      }
+    }
+
+    return r;
+  }
+
+ protected:
+  /* Routing table.
+   *
+   * Everything that's built from the servlets. Tables aren't changed after
+   * they're built, apart from the scratch space for matching, which each
+   * thread borrows for itself.
+   */
+  struct table {
+    /* Trie node. */
+    struct node {
+      /* Child nodes, by the next character. */
+      std::map<char, std::size_t> next;
+
+      /* Servlets with the prefix that leads to this node. */
+      std::vector<std::size_t> prefix;
+
+      /* Servlets that only match the prefix that leads to this node. */
+      std::vector<std::size_t> exact;
+    };
+
+    /* Scratch space for one match() at a time. */
+    struct scratch {
+      /* Deterministic states of <compiled>. */
+      automaton::deterministic states;
+
+      /* The automaton's results. */
+      std::vector<std::size_t> onResource, onQuery;
+    };
+
+    /* Trie nodes; the first one is the root. */
+    std::vector<node> nodes = std::vector<node>(1);
+
+    /* The servlets, in set order. */
+    std::vector<servlet *> order;
+
+    /* Whether any of the servlets want to match the query. */
+    bool anyQuery = false;
+
+    /* Combined automaton for all the regexen that it supports. */
+    automaton compiled;
+
+    /* Guards <spare>. */
+    mutable std::mutex lock;
+
+    /* Scratch space that no match() is using right now.
+     *
+     * The deterministic states are kept around in here, so they only ever
+     * have to be built once for each thread that matches at the same time.
+     */
+    mutable std::vector<std::unique_ptr<scratch>> spare;
+
+    /* Find servlets for a request.
+     * @resource The request's path.
+     * @resourceAndQuery The request's path, a question mark and the query;
+     *     or empty, to only look at the path.
+     *
+     * See router::match().
+     *
+     * @return The servlets that may apply, in set order.
+     */
+    std::vector<route> match(const std::string &resource,
+                             const std::string &resourceAndQuery) const {
+      std::unique_ptr<scratch> s;
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!spare.empty()) {
+          s = std::move(spare.back());
+          spare.pop_back();
+        }
+      }
+      if (!s) {
+        s.reset(new scratch());
+      }
+
+      std::vector<std::pair<std::size_t, route>> found;
+      const bool query = !resourceAndQuery.empty();
+      const std::string &text = query ? resourceAndQuery : resource;
+
+      compiled.match(text, resource.size(), s->onResource, s->onQuery,
+                     s->states);
+      for (const auto &o : s->onResource) {
+        found.push_back({o, route{order[o], true, false}});
+      }
+      for (const auto &o : s->onQuery) {
+        if (query && order[o]->matchQuery) {
+          found.push_back({o, route{order[o], false, true}});
+        }
+      }
+      for (const auto &o : candidates(resource, text)) {
+        const bool q = query && order[o]->matchQuery;
+        found.push_back({o, route{order[o], true, q}});
+      }
+
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        spare.push_back(std::move(s));
+      }
+
+      std::stable_sort(found.begin(), found.end(),
+                       [](const std::pair<std::size_t, route> &a,
+                          const std::pair<std::size_t, route> &b) {
+                         return a.first < b.first;
+                       });
+
+      std::vector<route> r;
+      for (std::size_t i = 0; i < found.size(); i++) {
+        if (i > 0 && found[i].first == found[i - 1].first) {
+          r.back().resource = r.back().resource || found[i].second.resource;
+          r.back().query = r.back().query || found[i].second.query;
+        } else {
+          r.push_back(found[i].second);
+        }
+      }
+      return r;
+    }
+
+    /* Find candidate servlets.
+     * @resource The request's path.
+     * @resourceAndQuery The request's path, a question mark and the query.
+     *
+     * Walks the trie along `resourceAndQuery`, collecting all the servlets
+     * with a prefix of it, and servlets whose exact resource is either of the
+     * two strings. Only servlets that aren't in the automaton are in the trie.
+     *
+     * @return The servlets whose resource regex may match, as sorted ordinals.
+     */
+    std::vector<std::size_t> candidates(
+        const std::string &resource,
+        const std::string &resourceAndQuery) const {
+      std::vector<std::size_t> ordinals;
+      std::size_t at = 0;
+
+      for (std::size_t i = 0;; i++) {
+        const auto &n = nodes[at];
+        ordinals.insert(ordinals.end(), n.prefix.begin(), n.prefix.end());
+        if (i == resource.size() || i == resourceAndQuery.size()) {
+          ordinals.insert(ordinals.end(), n.exact.begin(), n.exact.end());
+        }
+        if (i == resourceAndQuery.size()) {
+          break;
+        }
+
+        const auto next = n.next.find(resourceAndQuery[i]);
+        if (next == n.next.end()) {
+          break;
+        }
+        at = next->second;
+      }
+
+      std::sort(ordinals.begin(), ordinals.end());
+      ordinals.erase(std::unique(ordinals.begin(), ordinals.end()),
+                     ordinals.end());
+      return ordinals;
+    }
+  };
+
+  /* Guards <current>, <generation>, the cache, <hits> and <misses>. */
+  mutable std::mutex lock;
+
+  /* The current routing table. */
+  std::shared_ptr<const table> current;
+
+  /* The servlet::generation() that <current> was built for. */
+  std::size_t generation = 0;
+
+  /* Cached resolutions, most recently used first. */
+  std::list<std::pair<std::string, std::shared_ptr<const resolution>>> recent;
+
+  /* Cached resolutions, by path and query. */
+  std::unordered_map<std::string, decltype(recent)::iterator> cached;
+
+  /* Get the current routing table.
+   *
+   * @return The routing table; it won't change, even if the index is rebuilt.
+   */
+  std::shared_ptr<const table> index(void) const {
+    std::lock_guard<std::mutex> guard(lock);
+    return current;
+  }
+
+  /* Rebuild index.
+   * @servlets The servlets to index.
+   *
+   * Compiles all the servlets' resource regexen into the automaton, or puts
+   * them in the trie if that doesn't work. Cached resolutions are dropped, as
+   * they may refer to servlets that no longer exist. Requests that are still
+   * using the old table can keep doing so. Needs to be called with <lock>
+   * held; takes servlet::setLock() to go through the servlets.
+   */
+  template <typename set>
+  void rebuild(const set &servlets) {
+    const auto t = std::make_shared<table>();
+    auto &nodes = t->nodes;
+    std::lock_guard<std::mutex> guard(servlet::setLock());
+
+    for (const auto &s : servlets) {
+      t->anyQuery = t->anyQuery || s->matchQuery;
+      if (t->compiled.add(s->resourcex, t->order.size())) {
+        t->order.push_back(s);
+        continue;
+      }
+
+      const literal l = literalPrefix(s->resourcex);
+      std::size_t n = 0;
+
+      for (const auto &c : l.prefix) {
+        const auto next = nodes[n].next.find(c);
+        if (next != nodes[n].next.end()) {
+          n = next->second;
+        } else {
+          nodes[n].next[c] = nodes.size();
+          n = nodes.size();
+          nodes.push_back(table::node());
+        }
+      }
+
+      (l.exact ? nodes[n].exact : nodes[n].prefix).push_back(t->order.size());
+      t->order.push_back(s);
+    }
+
+    current = t;
+    recent.clear();
+    cached.clear();
+  }
+};
+}
+}
+
+#endif
@@ -17,15 +17,112 @@
 #if !defined(CXXHTTP_HTTP_SERVLET_H)
 #define CXXHTTP_HTTP_SERVLET_H
 
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <regex>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include <ef.gy/global.h>
 
+#include <cxxhttp/http-constants.h>
 #include <cxxhttp/http-header.h>
 #include <cxxhttp/http-session.h>
 
 namespace cxxhttp {
 namespace http {
+/* Set of known methods.
+ *
+ * Each of the methods in http::method has a bit in here, in the order that
+ * they appear in the set. Other methods don't have a bit, so they need to be
+ * matched against a servlet's method regex instead.
+ */
+using methodMask = unsigned;
+
+/* Look up a method's bit.
+ * @name The method name.
+ *
+ * @return The method's bit, or 0 if the method is not one of the known ones.
+ */
+static inline methodMask methodBit(const std::string &name) {
+  methodMask bit = 1;
+  for (const auto &m : method) {
+    if (m == name) {
+      return bit;
+    }
+    bit <<= 1;
+  }
+  return 0;
+}
+
+/* Look up method names.
+ * @mask A set of known methods.
+ *
+ * @return The names of the methods in `mask`.
+ */
+static inline std::set<std::string> methodNames(methodMask mask) {
+  std::set<std::string> r;
+  methodMask bit = 1;
+  for (const auto &m : method) {
+    if (mask & bit) {
+      r.insert(m);
+    }
+    bit <<= 1;
+  }
+  return r;
+}
+
+/* Match known methods.
+ * @methodx A method regex.
+ *
+ * @return The known methods that `methodx` matches.
+ */
+static inline methodMask methodMatches(const std::regex &methodx) {
+  methodMask r = 0, bit = 1;
+  for (const auto &m : method) {
+    if (std::regex_match(m, methodx)) {
+      r |= bit;
+    }
+    bit <<= 1;
+  }
+  return r;
+}
+
+/* Does a resource regex look at the query?
+ * @resourcex A resource regex.
+ *
+ * Servlets that want to see the query need a question mark in their resource
+ * regex, either escaped or in a character class, to match the one that
+ * separates the path from the query. That's what this looks for.
+ *
+ * @return 'true' if `resourcex` has a literal question mark in it.
+ */
+static inline bool mentionsQuery(const std::string &resourcex) {
+  bool inClass = false;
+  for (std::size_t i = 0; i < resourcex.size(); i++) {
+    const char c = resourcex[i];
+    if (c == '\\') {
+      if (i + 1 < resourcex.size() && resourcex[i + 1] == '?') {
+        return true;
+      }
+      i++;
+    } else if (inClass) {
+      if (c == '?') {
+        return true;
+      }
+      inClass = c != ']';
+    } else {
+      inClass = c == '[';
+    }
+  }
+  return false;
+}
+
 /* HTTP servlet container.
  *
  * This contains all the data needed to set up a subprocessor for the default
@@ -58,10 +155,59 @@ class servlet {
         resource(pResourcex),
         methodx(pMethodx),
         method(pMethodx),
+        methods(methodMatches(method)),
+        matchQuery(mentionsQuery(pResourcex)),
         negotiations(pNegotiations),
+        negotiators(compileNegotiations(pNegotiations)),
         handler(pHandler),
         description(pDescription),
-        beacon(*this, pSet) {}
+        beacon(*this, pSet) {
+    generation()++;
+    registered.guard.unlock();
+  }
+
+  /* Destructor.
+   *
+   * Waits for any blocking handlers that are still running, and makes sure the
+   * ones that haven't started yet won't. The servlet is then taken out of its
+   * set while holding setLock(), and only after that is the generation()
+   * bumped, so that routers pick up on the servlet being gone before the next
+   * request.
+   *
+   * Servlets that are still in a set that a server copied, or that a request
+   * is still being dispatched to, must not be destroyed.
+   */
+  ~servlet(void) {
+    life->end();
+    registered.guard.lock();
+  }
+
+  /* Servlet generation.
+   *
+   * Changes whenever a servlet is created or destroyed, which is how routers
+   * know when to rebuild their index without looking at every servlet. It is
+   * only ever changed once the servlet's set has been.
+   *
+   * @return The current generation.
+   */
+  static std::atomic<std::size_t> &generation(void) {
+    static std::atomic<std::size_t> g{0};
+    return g;
+  }
+
+  /* Servlet set lock.
+   *
+   * Servlets hold this while they add or remove themselves to or from their
+   * set. Anything that goes through a set of servlets while requests may be
+   * handled, or servlets may be created or destroyed, on other threads needs
+   * to hold it as well.
+   *
+   * @return The lock for all sets of servlets.
+   */
+  static std::mutex &setLock(void) {
+    static std::mutex lock;
+    return lock;
+  }
 
   /* Resource regex.
    *
@@ -92,6 +238,120 @@ class servlet {
    */
   const std::regex method;
 
+  /* Known methods.
+   *
+   * The methods from http::method that <method> matches, which is all that
+   * routing and the Allow header need for those methods, without running the
+   * regex again.
+   */
+  const methodMask methods;
+
+  /* Whether to match the query as well.
+   *
+   * If set, the resource regex is also matched against the path, a question
+   * mark and the query, if it doesn't match the path by itself. Defaults to
+   * whether the regex has a literal question mark in it; see mentionsQuery().
+   *
+   * Most servlets don't care about the query, so the server doesn't even put
+   * that string together unless one of its servlets has this set.
+   *
+   * Routers only look at this when a servlet is created or destroyed, so it
+   * needs to be set before the servlet is used.
+   */
+  bool matchQuery;
+
+  /* Whether the handler blocks.
+   *
+   * Set this for handlers that take a while to run, e.g. because they render
+   * templates or compress things. The server processor then runs them on its
+   * worker pool, rather than on the I/O thread, which can then get on with
+   * other connections. If the pool's queue is full, the request is answered
+   * with a 503 instead.
+   *
+   * While such a handler runs, it is the only thing using the session, but
+   * other sessions' requests are handled at the same time, by the I/O thread
+   * and other workers. Any state the handler shares with them needs to be
+   * guarded.
+   *
+   * The handler may only run a while after the request came in, so the servlet
+   * may be gone by then. If it is, the handler is skipped and the request goes
+   * to the servlets that are left. Destroying the servlet waits for handlers
+   * that have already started, so a handler must not destroy its own servlet.
+   */
+  bool blocking = false;
+
+  /* Servlet lifetime.
+   *
+   * Lets handlers that run on other threads find out whether their servlet is
+   * still around, and keeps it around until they're done.
+   */
+  class lifetime {
+   public:
+    /* Start running a handler.
+     *
+     * @return 'true' if the servlet is still around, in which case leave()
+     * needs to be called once the handler is done.
+     */
+    bool enter(void) {
+      std::lock_guard<std::mutex> guard(lock);
+      if (alive) {
+        running++;
+      }
+      return alive;
+    }
+
+    /* Done running a handler. */
+    void leave(void) {
+      std::lock_guard<std::mutex> guard(lock);
+      running--;
+      done.notify_all();
+    }
+
+    /* The servlet is going away.
+     *
+     * Waits for handlers that have been started, and turns down any others.
+     */
+    void end(void) {
+      std::unique_lock<std::mutex> guard(lock);
+      alive = false;
+      done.wait(guard, [this] { return running == 0; });
+    }
+
+   protected:
+    /* Guards <alive> and <running>. */
+    std::mutex lock;
+
+    /* Signalled when a handler is done. */
+    std::condition_variable done;
+
+    /* Whether the servlet is still around. */
+    bool alive = true;
+
+    /* Number of handlers that are running. */
+    std::size_t running = 0;
+  };
+
+  /* The servlet's lifetime.
+   *
+   * Shared with the jobs that run blocking handlers, which may outlive the
+   * servlet.
+   */
+  const std::shared_ptr<lifetime> life = std::make_shared<lifetime>();
+
+  /* Does the servlet accept a method?
+   * @name The request method.
+   * @mask The request method's bit, as per methodBit(); for HEAD requests,
+   *     this should include the bit for GET as well.
+   *
+   * Known methods are looked up in <methods>, other methods are matched
+   * against the method regex.
+   *
+   * @return 'true' if the servlet accepts the method.
+   */
+  bool allows(const std::string &name, methodMask mask) const {
+    return mask != 0 ? (methods & mask) != 0 : std::regex_match(name, method);
+  }
+
   /* Content negotiation data.
    *
    * This is a map of the form `header: valid options`. Any header specified
@@ -122,6 +382,13 @@ class servlet {
    */
   const http::headers negotiations;
 
+  /* Compiled content negotiation data.
+   *
+   * The same as <negotiations>, but with the server's side of each
+   * negotiation parsed once, here, rather than for every request.
+   */
+  const compiledNegotiations negotiators;
+
   /* Handler function.
    *
    * Will be invoked if the resource and method match the provided regexen, and
@@ -155,6 +422,21 @@ class servlet {
   }
 
  protected:
+  /* Registration guard.
+   *
+   * Holds setLock() while the beacon adds the servlet to its set, or removes
+   * it from there, and bumps the generation() once the latter is done. This
+   * needs to be declared right before <beacon>, so that it's constructed
+   * before and destroyed after it.
+   */
+  struct registration {
+    /* Holds setLock() while the set is changed. */
+    std::unique_lock<std::mutex> guard{setLock()};
+
+    /* Bump the generation after the servlet has been removed. */
+    ~registration(void) { generation()++; }
+  } registered;
+
   /* Servlet beacon.
    *
    * We need to keep track of all servlets in a central place, so that the
@@ -162,6 +444,172 @@ class servlet {
    */
   efgy::beacon<servlet> beacon;
 };
+
+/* Servlet with pre-rendered replies.
+ *
+ * For resources that always have the same content, like robots.txt or a health
+ * check. The complete reply, from the status line to the end of the body, is
+ * rendered once for every content type when the servlet is created, plus once
+ * more for HEAD requests. Replying then only means queueing the right one of
+ * those, which are shared rather than copied.
+ *
+ * The replies are rendered the same way that a regular servlet's reply would
+ * be, so the output is exactly the same as if a handler had replied with the
+ * same content.
+ */
+class staticServlet : public servlet {
+ public:
+  /* Content variants.
+   *
+   * Pairs of content types and the corresponding content. Content types may
+   * have q-values, which are used in content negotiation.
+   */
+  using variants = std::vector<std::pair<std::string, std::string>>;
+
+  /* Constructor.
+   * @pResourcex Regex for applicable resources.
+   * @pVariants The content to send, for each supported content type.
+   * @pHeader Any additional headers to send.
+   * @pDescription Optional API description string. URL recommended.
+   * @pSet Where to register the servlet; defaults to the global set.
+   *
+   * Only GET and HEAD are supported. The content types of all variants are
+   * negotiated against the client's Accept header.
+   *
+   * All replies are rendered before the servlet is registered, so it can be
+   * dispatched to as soon as it is in `pSet`.
+   */
+  staticServlet(
+      const std::string &pResourcex, const variants &pVariants,
+      const headers &pHeader = {},
+      const std::string &pDescription = "no description available",
+      efgy::beacons<servlet> &pSet = efgy::global<efgy::beacons<servlet>>())
+      : staticServlet(render(pVariants, pHeader), pResourcex, pVariants,
+                      pDescription, pSet) {}
+
+ protected:
+  /* Pre-rendered replies for one content type. */
+  struct rendering {
+    /* Reply to GET requests. */
+    std::shared_ptr<const std::string> full;
+
+    /* Reply to HEAD requests. */
+    std::shared_ptr<const std::string> head;
+  };
+
+  /* Pre-rendered replies, by content type.
+   *
+   * Indexed by the content type as it comes out of content negotiation.
+   */
+  using renderings = std::map<std::string, rendering>;
+
+  /* Pre-rendered replies.
+   *
+   * Shared with the handler, which doesn't need the servlet itself.
+   */
+  const std::shared_ptr<const renderings> rendered;
+
+  /* Constructor with pre-rendered replies.
+   * @pRendered The replies, as made by render().
+   * @pResourcex Regex for applicable resources.
+   * @pVariants The content to send, for each supported content type.
+   * @pDescription Optional API description string. URL recommended.
+   * @pSet Where to register the servlet.
+   */
+  staticServlet(std::shared_ptr<const renderings> pRendered,
+                const std::string &pResourcex, const variants &pVariants,
+                const std::string &pDescription, efgy::beacons<servlet> &pSet)
+      : servlet(pResourcex,
+                [pRendered](sessionData &session, std::smatch &) {
+                  serve(*pRendered, session);
+                },
+                "GET", {{"Accept", accept(pVariants)}}, pDescription, pSet),
+        rendered(pRendered) {}
+
+  /* List content types.
+   * @pVariants The content variants.
+   *
+   * @return The content types of all variants, for content negotiation.
+   */
+  static std::string accept(const variants &pVariants) {
+    std::string r;
+    for (const auto &v : pVariants) {
+      r += (r.empty() ? "" : ", ") + v.first;
+    }
+    return r;
+  }
+
+  /* Render replies for all content types.
+   * @pVariants The content to send, for each supported content type.
+   * @header Any additional headers to send.
+   *
+   * For each variant, sets up a session just like the server processor would
+   * for a request that only accepts its content type, and has it generate the
+   * replies.
+   *
+   * @return The replies, by negotiated content type.
+   */
+  static std::shared_ptr<const renderings> render(const variants &pVariants,
+                                                  const headers &header) {
+    const auto negotiators =
+        compileNegotiations({{"Accept", accept(pVariants)}});
+    auto rv = std::make_shared<renderings>();
+    for (const auto &v : pVariants) {
+      render(*rv, negotiators, v.first, v.second, header);
+    }
+    return rv;
+  }
+
+  /* Render replies for a content type.
+   * @into Where to put the replies.
+   * @negotiators The servlet's content negotiations.
+   * @type The content type.
+   * @content The content to send for that type.
+   * @header Any additional headers to send.
+   *
+   * Sets up a session just like the server processor would for a request that
+   * only accepts `type`, and has it generate the replies.
+   */
+  static void render(renderings &into,
+                     const compiledNegotiations &negotiators,
+                     const std::string &type, const std::string &content,
+                     const headers &header) {
+    sessionData session;
+    session.outbound = {defaultServerHeaders};
+    session.inbound.header["Accept"] = type;
+
+    if (!session.negotiate(negotiators)) {
+      return;
+    }
+
+    rendering &r = into[session.negotiated["Accept"]];
+    r.full = std::make_shared<const std::string>(
+        session.generateReply(200, content, header));
+    session.isHEAD = true;
+    r.head = std::make_shared<const std::string>(
+        session.generateReply(200, content, header));
+  }
+
+  /* Send pre-rendered reply.
+   * @replies The pre-rendered replies.
+   * @session The session to reply to.
+   *
+   * Looks up the reply for the negotiated content type. Does not reply if
+   * there is none, which lets the processor send an error instead.
+   */
+  static void serve(const renderings &replies, sessionData &session) {
+    const auto type = session.negotiated.find("Accept");
+    if (type == session.negotiated.end()) {
+      return;
+    }
+
+    const auto r = replies.find(type->second);
+    if (r != replies.end()) {
+      session.queueReply(
+          200, message{"", session.isHEAD ? r->second.head : r->second.full});
+    }
+  }
+};
 }
 }
 
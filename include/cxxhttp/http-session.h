@@ -15,13 +15,22 @@
 #if !defined(CXXHTTP_HTTP_SESSION_H)
 #define CXXHTTP_HTTP_SESSION_H
 
+#include <atomic>
+#include <chrono>
+#include <functional>
 #include <list>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include <cxxhttp/negotiate.h>
 #include <cxxhttp/network.h>
+#include <cxxhttp/scan.h>
 #include <cxxhttp/version.h>
 
 #include <cxxhttp/http-header.h>
+#include <cxxhttp/http-message.h>
 #include <cxxhttp/http-request.h>
 #include <cxxhttp/http-status.h>
 
@@ -35,6 +44,27 @@ static const headers sendNegotiatedAs{
     {"Accept", "Content-Type"},
 };
 
+/* Compiled content negotiations.
+ *
+ * Header names, along with the pre-parsed values that the server accepts for
+ * them. This is how servlets keep their negotiation data.
+ */
+using compiledNegotiations = std::vector<std::pair<std::string, negotiator>>;
+
+/* Compile content negotiations.
+ * @negotiations Map of header names to the values the server accepts.
+ *
+ * @return The negotiations, with the server's values parsed.
+ */
+static inline compiledNegotiations compileNegotiations(
+    const headers &negotiations) {
+  compiledNegotiations r;
+  for (const auto &n : negotiations) {
+    r.push_back({n.first, negotiator(n.second)});
+  }
+  return r;
+}
+
 /* Default client headers.
  *
  * These headers are sent by default with every client request, unless
@@ -44,6 +74,14 @@ static const headers defaultClientHeaders{
     {"User-Agent", identifier},
 };
 
+/* Default servers headers.
+ *
+ * These headers are sent by default with every server reply, unless overriden.
+ */
+static const headers defaultServerHeaders{
+    {"Server", identifier},
+};
+
 /* Transport-agnostic HTTP session data.
  *
  * For all the bits in an HTTP session object that do not rely on knowing the
@@ -138,6 +176,15 @@ class sessionData {
    */
   std::size_t replies;
 
+  /* How many writes this session has made.
+   *
+   * Several queued messages may be sent with a single write, so comparing this
+   * to <queries> shows how well that works out.
+   *
+   * This variable must only increase in value.
+   */
+  std::size_t writes;
+
   /* How many transport errors has this session seen.
    *
    * This counter is increased whenever some transport operation failed. We
@@ -145,13 +192,13 @@ class sessionData {
    */
   std::size_t errors;
 
-  /* A flat buffer of things we still need to send.
+  /* A queue of things we still need to send.
    *
    * Each reply() records what we want to send, here. This is to get around the
    * problem of needing to know the exact session type for reply operations,
    * while also making it easier to run tests on this.
    */
-  std::list<std::string> outboundQueue;
+  std::list<message> outboundQueue;
 
   /* Whether to close the connection after sending something.
    *
@@ -170,9 +217,11 @@ class sessionData {
   /* Whether the session is "free".
    *
    * A free session can be used for a new connection. This is set to false as
-   * soon as an accept is pending against the session's socket.
+   * soon as an accept is pending against the session's socket. It's set from
+   * the session's own handlers, but read by whatever picks a session for the
+   * next connection, which may be a different thread.
    */
-  bool free;
+  std::atomic<bool> free;
 
   /* The currently processing request is a HEAD request.
    *
@@ -183,6 +232,39 @@ class sessionData {
    */
   bool isHEAD;
 
+  /* Resume a deferred request.
+   *
+   * Set up by the flow that the session belongs to. To process a request
+   * somewhere else, e.g. on a worker thread, a processor sets <status> to
+   * stDeferred and returns. The flow then stops reading and sending until this
+   * is called, from wherever, with a function to finish up with. That function
+   * is run on the session's own strand, and afterwards the flow carries on as
+   * though the request had just been processed, unless the function deferred
+   * it again.
+   *
+   * Nothing but the request's handler may use the session while the request is
+   * deferred, and this must be called exactly once for each deferral.
+   *
+   * Empty if the session doesn't belong to a flow, in which case requests can't
+   * be deferred.
+   */
+  std::function<void(std::function<void(void)>)> resume;
+
+  /* Give up on a deferred request.
+   *
+   * Set by whatever deferred the request, if anything. The flow calls this if
+   * the request is still deferred after <deferTimeout>, and it should then
+   * resume the request with an error reply. See http::deferred.
+   */
+  std::function<void(void)> expire;
+
+  /* How long to wait before giving up on a deferred request.
+   *
+   * Picked up by the flow when the request is deferred, and reset to 0, which
+   * means to wait forever.
+   */
+  std::chrono::milliseconds deferTimeout{0};
+
   /* Default constructor
    *
    * Sets up an empty data object with default values for the members that need
@@ -193,12 +275,25 @@ class sessionData {
         contentLength(0),
         requests(0),
         replies(0),
+        writes(0),
         errors(0),
         closeAfterSend(false),
         writePending(false),
         free(false),
         isHEAD(false) {}
 
+  /* Query parameters of the current request.
+   *
+   * These are only split up the first time a handler asks for them; see
+   * uri::parameters().
+   *
+   * @return The `name=value` pairs from the request's query, still encoded.
+   */
+  const std::vector<std::pair<stringView, stringView>> &queryParameters(
+      void) const {
+    return inboundRequest.resource.parameters();
+  }
+
   /* Calculate number of queries from this session.
    *
    * Calculates the total number of queries that this session has sent. Inbound
@@ -220,13 +315,23 @@ class sessionData {
     return contentLength - content.size();
   }
 
-  /* Generate an HTTP reply message.
+  /* Whether a reply gets a message body.
    * @status The status to return.
-   * @body The response body to send back to the client.
+   *
+   * Informational replies never have a body, and neither do replies to HEAD
+   * requests.
+   *
+   * @return 'true' if a reply with the given status would include its body.
+   */
+  bool replyHasBody(int status) const { return status >= 200 && !isHEAD; }
+
+  /* Generate an HTTP reply header block.
+   * @status The status to return.
+   * @length The size of the response body.
    * @header The headers to send.
    *
-   * The reply() function uses this to create the text it will send. Headers are
-   * not checked for validity.
+   * The generateReply() functions use this to create the status line and
+   * headers. Headers are not checked for validity.
    *
    * This function will automatically add a Content-Length header for the body,
    * and will also append to the Server header, if the agent string is set.
@@ -235,12 +340,10 @@ class sessionData {
    * version in the request. If this is a concern for you, put the server behind
    * an nginx instance, which should fix up the output as necessary.
    *
-   * @return The raw HTTP message to be sent.
+   * @return The status line and headers, including the final empty line.
    */
-  std::string generateReply(int status, const std::string &body,
-                            const headers &header = {}) {
-    // informational responses have no message body.
-    bool allowBody = status >= 200 && !isHEAD;
+  std::string replyHeader(int status, std::size_t length,
+                          const headers &header = {}) {
     // we automatically close connections when an error code is sent.
     bool allowKeepAlive = status < 400;
 
@@ -248,9 +351,9 @@ class sessionData {
 
     // We set the Content-Length header for HEAD requests, even though those
     // do not actually get a body.
-    if (allowBody || isHEAD) {
+    if (replyHasBody(status) || isHEAD) {
       head.insert({
-          {"Content-Length", std::to_string(body.size())},
+          {"Content-Length", std::to_string(length)},
       });
     }
     if (!allowKeepAlive) {
@@ -266,11 +369,70 @@ class sessionData {
     // they haven't been overridden.
     head.insert(outbound.header);
 
-    std::string reply =
-        std::string(statusLine(status)) + std::string(head) + "\r\n";
+    return std::string(statusLine(status)) + std::string(head) + "\r\n";
+  }
 
-    if (allowBody) {
-      reply += body;
+  /* Generate an HTTP reply message.
+   * @status The status to return.
+   * @body The response body to send back to the client.
+   * @header The headers to send.
+   *
+   * The reply() function uses this to create the message it will send. See
+   * replyHeader() for how the status line and headers are created.
+   *
+   * The body is only referenced by the message, so the same body can be sent
+   * any number of times without being copied.
+   *
+   * @return The HTTP message to be sent.
+   */
+  message generateReply(int status, std::shared_ptr<const std::string> body,
+                        const headers &header = {}) {
+    message reply{replyHeader(status, body ? body->size() : 0, header)};
+
+    if (replyHasBody(status) && body && !body->empty()) {
+      reply.body = std::move(body);
+    }
+
+    return reply;
+  }
+
+  /* Generate an HTTP reply message.
+   * @status The status to return.
+   * @body The response body to send back to the client.
+   * @header The headers to send.
+   *
+   * Like the other generateReply() functions, but takes over the body instead
+   * of copying it.
+   *
+   * @return The HTTP message to be sent.
+   */
+  message generateReply(int status, std::string &&body,
+                        const headers &header = {}) {
+    message reply{replyHeader(status, body.size(), header)};
+
+    if (replyHasBody(status) && !body.empty()) {
+      reply.body = std::make_shared<const std::string>(std::move(body));
+    }
+
+    return reply;
+  }
+
+  /* Generate an HTTP reply message.
+   * @status The status to return.
+   * @body The response body to send back to the client.
+   * @header The headers to send.
+   *
+   * Like the other generateReply() functions, but copies the body, if it is
+   * going to be sent at all.
+   *
+   * @return The HTTP message to be sent.
+   */
+  message generateReply(int status, const std::string &body,
+                        const headers &header = {}) {
+    message reply{replyHeader(status, body.size(), header)};
+
+    if (replyHasBody(status) && !body.empty()) {
+      reply.body = std::make_shared<const std::string>(body);
     }
 
     return reply;
@@ -299,6 +461,25 @@ class sessionData {
     return s;
   }
 
+  /* Look at the next line of input.
+   *
+   * Like buffer(), but without copying or extracting anything: the view refers
+   * to the bytes in `input`, up to and including the first newline, or to all
+   * of `input` if there is no newline yet. Call `input.consume()` with the size
+   * of the line once it's been dealt with.
+   *
+   * The view is only good until `input` is modified.
+   *
+   * @return The next line in `input`.
+   */
+  stringView line(void) const {
+    const auto data = input.data();
+    const stringView all(asio::buffer_cast<const char *>(data),
+                         asio::buffer_size(data));
+    const std::size_t n = scan::find(all, '\n');
+    return n == stringView::npos ? all : all.substr(0, n + 1);
+  }
+
   /* Negotiate headers for request.
    * @negotiations The set of negotiations to perform, from the servlet.
    *
@@ -311,13 +492,26 @@ class sessionData {
    * @return Whether or not negotiations were successful.
    */
   bool negotiate(const headers &negotiations) {
+    return negotiate(compileNegotiations(negotiations));
+  }
+
+  /* Negotiate headers with pre-parsed server values.
+   * @negotiations The negotiations to perform.
+   *
+   * Like the other negotiate() function, but the server's side doesn't need
+   * to be parsed again; only the client's headers are.
+   *
+   * @return 'true' if all negotiations were successful.
+   */
+  bool negotiate(const compiledNegotiations &negotiations) {
+    static const std::string none;
     bool badNegotiation = false;
     // reset, and perform, header value negotiation based on the servlet's specs
     // and the client data.
     negotiated = {};
     for (const auto &n : negotiations) {
-      const std::string cv =
-          inbound.header.count(n.first) > 0 ? inbound.header[n.first] : "";
+      const auto h = inbound.header.find(n.first);
+      const std::string &cv = h != inbound.header.end() ? h->second : none;
       const std::string v = cxxhttp::negotiate(cv, n.second);
 
       // modify the Vary value to indicate we used this header.
@@ -376,8 +570,9 @@ class sessionData {
     parser<headers> head{header};
     head.insert(defaultClientHeaders);
 
-    outboundQueue.push_back(requestLine(method, resource).assemble() +
-                            std::string(head) + "\r\n" + body);
+    outboundQueue.push_back(message{
+        requestLine(method, resource).assemble() + std::string(head) + "\r\n",
+        body.empty() ? nullptr : std::make_shared<const std::string>(body)});
 
     isHEAD = method == "HEAD";
 
@@ -393,13 +588,49 @@ class sessionData {
    * contained in this object.
    *
    * The actual message to send is generated using the generateReply() function,
-   * which receives all the parameters passed in.
+   * which receives all the parameters passed in. Pass the body as an rvalue or
+   * a shared pointer to avoid copying it.
    *
    * This actually only queues up the send operation, which is picked up by the
    * `send()` function in the session proper.
    */
   void reply(int status, const std::string &body, const headers &header = {}) {
-    outboundQueue.push_back(generateReply(status, body, header));
+    queueReply(status, generateReply(status, body, header));
+  }
+
+  /* Send reply with custom header map.
+   * @status The status to return.
+   * @body The response body to send back to the client.
+   * @header The headers to send.
+   *
+   * Same as the other reply() functions, but takes over the body.
+   */
+  void reply(int status, std::string &&body, const headers &header = {}) {
+    queueReply(status, generateReply(status, std::move(body), header));
+  }
+
+  /* Send reply with custom header map.
+   * @status The status to return.
+   * @body The response body to send back to the client.
+   * @header The headers to send.
+   *
+   * Same as the other reply() functions, but shares the body. Use this to send
+   * the same, immutable body in response to many requests.
+   */
+  void reply(int status, std::shared_ptr<const std::string> body,
+             const headers &header = {}) {
+    queueReply(status, generateReply(status, std::move(body), header));
+  }
+
+  /* Queue a reply.
+   * @status The status of the reply.
+   * @msg The reply itself.
+   *
+   * Used by the reply() functions to queue the message and update the
+   * session's state to match.
+   */
+  void queueReply(int status, message &&msg) {
+    outboundQueue.push_back(std::move(msg));
 
     closeAfterSend = closeAfterSend || status >= 400;
 
@@ -14,8 +14,6 @@
 #if !defined(CXXHTTP_HTTP_STATUS_H)
 #define CXXHTTP_HTTP_STATUS_H
 
-#include <regex>
-
 #include <cxxhttp/http-constants.h>
 #include <cxxhttp/http-grammar.h>
 #include <cxxhttp/http-version.h>
@@ -54,23 +52,33 @@ class statusLine {
    * This currently only accepts HTTP/1.0 and HTTP/1.1 status lines, all others
    * will be rejected.
    */
-  statusLine(const std::string &line) : statusLine() {
-    static const std::regex stat(grammar::httpVersion + " (" +
-                                 grammar::statusCode + ") (" +
-                                 grammar::reasonPhrase + ")\r?\n?");
-    std::smatch matches;
-    bool matched = std::regex_match(line, matches, stat);
-
-    if (matched) {
-      const std::string maj = matches[1];
-      const std::string min = matches[2];
-      version = {maj, min};
-      description = matches[4];
-      // we pre-validate that this is a number in the range of 100-999 with the
-      // regex, so while this could ordinarily throw an exception it would be
-      // programme-terminatingly bad if it did here.
-      code = std::stoi(matches[3]);
+  statusLine(const std::string &line) : statusLine(stringView(line)) {}
+
+  /* Parse HTTP status line in place.
+   * @line The (suspected) status line to parse.
+   *
+   * Scans the line directly, so that the flow control can hand us a line that
+   * is still in its input buffer. Nothing is set unless the whole line turns
+   * out to be valid.
+   */
+  statusLine(const stringView &line) : statusLine() {
+    const stringView l = grammar::stripNewline(line);
+
+    // "HTTP/x.x NNN ", with the reason phrase being allowed to be empty.
+    if (l.size() < 13 || !grammar::isHttpVersion(l.substr(0, 8)) ||
+        l[8] != ' ' || !grammar::isDigit(l[9]) || !grammar::isDigit(l[10]) ||
+        !grammar::isDigit(l[11]) || l[12] != ' ') {
+      return;
+    }
+
+    const stringView reason = l.substr(13);
+    if (!grammar::validReasonPhrase(reason)) {
+      return;
     }
+
+    version = http::version(l.substr(0, 8));
+    description = reason;
+    code = (l[9] - '0') * 100 + (l[10] - '0') * 10 + (l[11] - '0');
   }
 
   /* Create status line with status and protocol.
@@ -55,8 +55,13 @@ class session : public sessionData {
    *
    * Only allows specifying the I/O service, because the input and output file
    * descriptor IDs are fixed for STDIO.
+   *
+   * STDIO sessions are mostly used for debugging, so these read and process
+   * input one line at a time.
    */
-  session(asio::io_service &service) : flow(processor, service, *this, 0, 1) {}
+  session(asio::io_service &service) : flow(processor, service, *this, 0, 1) {
+    flow.readBlocks = false;
+  }
 
   /* Start processing.
    *
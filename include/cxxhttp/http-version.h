@@ -18,6 +18,8 @@
 #include <array>
 #include <string>
 
+#include <cxxhttp/http-grammar.h>
+
 namespace cxxhttp {
 namespace http {
 /* HTTP protocol version and assorted functions.
@@ -52,6 +54,19 @@ class version : public std::array<int, 2> {
   version(const std::string &major, const std::string &minor)
       : std::array<int, 2>({{std::stoi(major), std::stoi(minor)}}) {}
 
+  /* Parse an HTTP version.
+   * @text The version to parse, e.g. "HTTP/1.1".
+   *
+   * Anything that doesn't match grammar::httpVersion results in HTTP/0.0,
+   * which is not valid.
+   */
+  version(const stringView &text) : version() {
+    if (grammar::isHttpVersion(text)) {
+      (*this)[0] = text[5] - '0';
+      (*this)[1] = text[7] - '0';
+    }
+  }
+
   /* Report if a version is valid.
    *
    * The earliest version we consider valid is HTTP/0.9.
@@ -35,31 +35,31 @@ static void options(http::sessionData &session, std::smatch &re) {
       "# Applicable Resource Processors\n\n"
       "The following servlets are built into the application and match the "
       "given resource:\n\n";
-  std::set<std::string> methods{};
+  http::methodMask methods = 0;
+  const http::methodMask get = http::methodBit("GET");
   const std::string full = re[0];
 
+  std::unique_lock<std::mutex> guard(http::servlet::setLock());
   const auto &servlets = efgy::global<efgy::beacons<http::servlet>>();
   for (const auto &servlet : servlets) {
     if ((full == "*") || std::regex_match(full, servlet->resource)) {
       text += servlet->describe();
-      for (const auto &m : http::method) {
-        if (std::regex_match(m, servlet->method)) {
-          methods.insert(m);
-        }
-        if (std::regex_match("GET", servlet->method)) {
-          methods.insert("HEAD");
-        }
+      methods |= servlet->methods;
+      if (servlet->methods & get) {
+        methods |= http::methodBit("HEAD");
       }
     }
   }
 
+  guard.unlock();
+
   http::parser<http::headers> p{};
 
-  for (const auto &m : methods) {
+  for (const auto &m : http::methodNames(methods)) {
     p.append("Allow", m);
   }
 
-  session.reply(200, text, p.header);
+  session.reply(200, std::move(text), p.header);
 }
 
 /* HTTP OPTIONS location regex.
@@ -16,6 +16,7 @@
 #define CXXHTTP_HTTPD_H
 
 #include <cstdio>
+#include <mutex>
 
 #include <ef.gy/cli.h>
 
@@ -50,6 +51,7 @@ static bool setup(net::endpoint<transport> lookup,
   for (net::endpointType<transport> endpoint : lookup) {
     auto &s = http::server<transport>::get(endpoint, servers, service);
 
+    std::lock_guard<std::mutex> guard(http::servlet::setLock());
     s.processor.servlets = servlets;
 
     rv = rv || true;
@@ -71,7 +73,10 @@ static inline bool setup(service &service = efgy::global<cxxhttp::service>(),
                          efgy::beacons<http::servlet> &servlets =
                              efgy::global<efgy::beacons<http::servlet>>()) {
   static http::stdio::server server(service);
-  server.processor.servlets = servlets;
+  {
+    std::lock_guard<std::mutex> guard(http::servlet::setLock());
+    server.processor.servlets = servlets;
+  }
   server.start();
   return true;
 }
@@ -80,14 +85,25 @@ static inline bool setup(service &service = efgy::global<cxxhttp::service>(),
  * @match The matches from the TCP regex.
  *
  * This uses setup() to create a server on the interface specified with match[1]
- * and the port specified with match[2].
+ * and the port specified with match[2], once for each shard, on that shard's
+ * I/O service.
  * The server will have the default HTTP processor, with all registered TCP
  * servlets applied.
  *
  * @return 'true' if the setup was successful.
  */
 static inline bool setupTCP(std::smatch &match) {
-  return setup(net::endpoint<transport::tcp>(match[1], match[2]));
+  bool rv = true;
+
+  for (std::size_t i = 0; i < shards; i++) {
+    auto &io = shard(i);
+    rv = setup(net::endpoint<transport::tcp>(match[1], match[2], io),
+               efgy::global<efgy::beacons<http::server<transport::tcp>>>(),
+               io) &&
+         rv;
+  }
+
+  return rv;
 }
 
 /* Whether or not to delete new UNIX sockets.
@@ -167,6 +183,7 @@ namespace usage {
  */
 static std::string describe(void) {
   std::string rv;
+  std::lock_guard<std::mutex> guard(http::servlet::setLock());
   const auto &servlets = efgy::global<efgy::beacons<http::servlet>>();
   for (const auto &servlet : servlets) {
     rv += servlet->describe();
@@ -15,9 +15,13 @@
 #if !defined(CXXHTTP_MIME_TYPE_H)
 #define CXXHTTP_MIME_TYPE_H
 
+#include <algorithm>
+#include <array>
+#include <cstring>
 #include <map>
-#include <regex>
+#include <memory>
 
+#include <cxxhttp/http-grammar.h>
 #include <cxxhttp/string.h>
 
 namespace cxxhttp {
@@ -107,9 +111,11 @@ class mimeType {
         state = inValueEscaped;
       } else if (state == inValueQuoted) {
         value.push_back(c);
-      } else if (state == inType && isToken(c) && (!space || type.empty())) {
+      } else if (state == inType && isToken(c) &&
+                 (!space || type.empty())) {
         type.push_back(std::tolower(c));
-      } else if (state == inSub && isToken(c) && (!space || subtype.empty())) {
+      } else if (state == inSub && isToken(c) &&
+                 (!space || subtype.empty())) {
         subtype.push_back(std::tolower(c));
       } else if (state == inKey && isToken(c) && (!space || key.empty())) {
         key.push_back(std::tolower(c));
@@ -127,12 +133,12 @@ class mimeType {
         value.clear();
       } else if (state == inKey && c == '=') {
         state = inValue;
-      } else if (!isSpace(c)) {
+      } else if (!http::grammar::isWhitespace(c)) {
         // ignore free spaces; this is somewhat more lenient than the original
         // grammar, but then that also insists on some level of leniency there.
         isValid = false;
       }
-      space = isSpace(c);
+      space = http::grammar::isWhitespace(c);
     }
 
     isValid = isValid && (state == inSub || state == inValue) &&
@@ -141,6 +147,10 @@ class mimeType {
     if (isValid && state == inValue) {
       attributes[key] = value;
     }
+
+    if (isValid) {
+      known = intern(type, subtype);
+    }
   }
 
   /* Normalise string.
@@ -155,38 +165,48 @@ class mimeType {
       return "invalid";
     }
 
-    std::string rv = type + "/" + subtype;
-    for (const auto &a : attributes) {
-      std::string value;
-      bool quotes = false;
-      for (const auto &v : a.second) {
-        if (!isToken(v)) {
-          quotes = true;
-          if (isCTL(v) || v == '"' || v == '\\') {
-            value.push_back('\\');
-          }
-        }
-        value.push_back(v);
-      }
-      rv += "; " + a.first + "=" + (quotes ? "\"" + value + "\"" : value);
+    auto c = std::atomic_load(&normalised.current);
+    if (!c || c->type != type || c->subtype != subtype ||
+        c->attributes != attributes) {
+      c = std::make_shared<const cache::entry>(
+          cache::entry{type, subtype, attributes, normalise()});
+      std::atomic_store(&normalised.current, c);
     }
-
-    return rv;
+    return c->normalised;
   }
 
   /* Less-than comparator.
    * @b Right-hand side of the comparison.
    *
    * Compares the value in `b` to this value, and returns `true` if this value
-   * is considered to come before the `b` value in a lexical sort.
+   * is considered to come before the `b` value in a structural sort: by type,
+   * then subtype, then attributes. Invalid types come before valid ones.
    *
-   * This is implemented using the normalised string form of the two types in
-   * question.
+   * If both types are still in the interning table, the type and subtype are
+   * compared by their position in the table, which is in the same order.
    *
    * @return Whether this value is less than `b`.
    */
   bool operator<(const mimeType &b) const {
-    return std::string(*this) < std::string(b);
+    if (!valid() || !b.valid()) {
+      return !valid() && b.valid();
+    }
+
+    const std::size_t k = id(), bk = b.id();
+    if (k == 0 || bk == 0) {
+      const int t = type.compare(b.type);
+      if (t != 0) {
+        return t < 0;
+      }
+      const int s = subtype.compare(b.subtype);
+      if (s != 0) {
+        return s < 0;
+      }
+    } else if (k != bk) {
+      return k < bk;
+    }
+
+    return attributes < b.attributes;
   }
 
   /* Equality operator.
@@ -200,10 +220,19 @@ class mimeType {
    * @return Whether or not the two mime types match.
    */
   bool operator==(const mimeType &b) const {
-    return valid() && b.valid() && (!wildcard() || !b.wildcard()) &&
-           (type == "*" || b.type == "*" || type == b.type) &&
-           (subtype == "*" || b.subtype == "*" || subtype == b.subtype) &&
-           (attributes == b.attributes);
+    if (!valid() || !b.valid() || (wildcard() && b.wildcard())) {
+      return false;
+    }
+
+    const std::size_t k = id();
+    if (k == 0 || k != b.id()) {
+      if (!(type == "*" || b.type == "*" || type == b.type) ||
+          !(subtype == "*" || b.subtype == "*" || subtype == b.subtype)) {
+        return false;
+      }
+    }
+
+    return attributes == b.attributes;
   }
 
   /* Does this media type contain wildcards?
@@ -225,57 +254,157 @@ class mimeType {
    */
   bool isValid;
 
-  /* Check character against the set of control characters.
-   * @c The character to check.
+  /* Interned type and subtype.
    *
-   * The set of control characters is defined in RFC 822, section 3.3.
+   * One past the position of the type and subtype in the interning table, or
+   * 0 if they're not in it. Set by the parse; see id() for whether it still
+   * applies.
+   */
+  std::size_t known = 0;
+
+  /* Normalised string cache.
    *
-   * @return Reports whether the character is a control character.
+   * Filled in on the first conversion to std::string, along with the fields it
+   * was built from, so that it's built again if any of those have changed
+   * since. Entries are swapped atomically, so a shared instance can be
+   * converted on several threads at once.
    */
-  static bool isCTL(int c) { return c <= 31 || c == 127; }
+  struct cache {
+    /* A normalised string and the fields it was built from. */
+    struct entry {
+      std::string type, subtype;
+      attributeMap attributes;
+      std::string normalised;
+    };
 
-  /* Check character against the set of special characters.
-   * @c The character to check.
+    /* The current entry; empty until the first conversion. */
+    std::shared_ptr<const entry> current;
+
+    cache(void) {}
+    cache(const cache &c) : current(std::atomic_load(&c.current)) {}
+    cache &operator=(const cache &c) {
+      std::atomic_store(&current, std::atomic_load(&c.current));
+      return *this;
+    }
+  };
+
+  /* Normalised string, once it's been asked for. */
+  mutable cache normalised;
+
+  /* Interned type and subtype, as they are now.
+   *
+   * The ID from the parse is only used while the type and subtype still match
+   * its table entry, as both are public and may have been changed since.
+   * Comparing by name is always right, so a type that no longer matches is
+   * simply treated as not interned.
    *
-   * Defined in RFC 2045, section 5.1.
+   * @return One past the position of the type in the table, or 0 if it's not
+   * interned.
+   */
+  std::size_t id(void) const {
+    if (known == 0) {
+      return 0;
+    }
+    const auto &k = table()[known - 1];
+    return type == k.first && subtype == k.second ? known : 0;
+  }
+
+  /* Interning table.
    *
-   * If any of these characters occurs in a parameter value, that value needs to
-   * be in quotes.
+   * Has types that come up in most negotiations, sorted by type and then
+   * subtype, so that their positions sort the same way the types themselves
+   * would.
    *
-   * @return Reports whether the character is a special character.
+   * @return The table.
    */
-  static bool isTSpecial(int c) {
-    switch (c) {
-      case '(':
-      case ')':
-      case '<':
-      case '>':
-      case '@':
-      case ',':
-      case ';':
-      case ':':
-      case '\\':
-      case '"':
-      case '/':
-      case '[':
-      case ']':
-      case '?':
-      case '=':
-        return true;
-      default:
-        return false;
+  static const std::array<std::pair<const char *, const char *>, 22> &table(
+      void) {
+    static const std::array<std::pair<const char *, const char *>, 22> rv{{
+        {"*", "*"},
+        {"application", "*"},
+        {"application", "javascript"},
+        {"application", "json"},
+        {"application", "octet-stream"},
+        {"application", "x-www-form-urlencoded"},
+        {"application", "xhtml+xml"},
+        {"application", "xml"},
+        {"image", "*"},
+        {"image", "avif"},
+        {"image", "gif"},
+        {"image", "jpeg"},
+        {"image", "png"},
+        {"image", "svg+xml"},
+        {"image", "webp"},
+        {"text", "*"},
+        {"text", "css"},
+        {"text", "csv"},
+        {"text", "html"},
+        {"text", "markdown"},
+        {"text", "plain"},
+        {"text", "xml"},
+    }};
+    return rv;
+  }
+
+
+  /* Look up a type in the interning table.
+   * @pType The type to look up.
+   * @pSubtype The subtype to look up.
+   *
+   * See table() for what's in the table.
+   *
+   * @return One past the position of the type in the table, or 0 if it's not
+   * in there.
+   */
+  static std::size_t intern(const std::string &pType,
+                            const std::string &pSubtype) {
+    const auto less = [](const std::pair<const char *, const char *> &a,
+                         const std::pair<const char *, const char *> &b) {
+      const int t = std::strcmp(a.first, b.first);
+      return t < 0 || (t == 0 && std::strcmp(a.second, b.second) < 0);
+    };
+    const std::pair<const char *, const char *> k{pType.c_str(),
+                                                  pSubtype.c_str()};
+    const auto &t = table();
+    const auto it = std::lower_bound(t.begin(), t.end(), k, less);
+    if (it == t.end() || less(k, *it)) {
+      return 0;
     }
+    return it - t.begin() + 1;
   }
 
-  /* Check if character can be represented with 7 bits.
+  /* Build the normalised string.
+   *
+   * @return The string that the std::string conversion operator returns.
+   */
+  std::string normalise(void) const {
+    std::string rv = type + "/" + subtype;
+    for (const auto &a : attributes) {
+      std::string value;
+      bool quotes = false;
+      for (const auto &v : a.second) {
+        if (!isToken(v)) {
+          quotes = true;
+          if (isCTL(v) || v == '"' || v == '\\') {
+            value.push_back('\\');
+          }
+        }
+        value.push_back(v);
+      }
+      rv += "; " + a.first + "=" + (quotes ? "\"" + value + "\"" : value);
+    }
+
+    return rv;
+  }
+
+  /* Check character against the set of control characters.
    * @c The character to check.
    *
-   * MIME is a 7-bit protocol at heart, so the header fields, and by extension
-   * the MIME types need to be 7-bit safe.
+   * The set of control characters is defined in RFC 822, section 3.3.
    *
-   * @return Reports whether the character is a valid 7-bit ASCII character.
+   * @return Reports whether the character is a control character.
    */
-  static bool is7Bit(int c) { return c >= 0 && c <= 127; }
+  static bool isCTL(int c) { return c <= 31 || c == 127; }
 
   /* Check whether the character is a valid token character.
    * @c The character to check.
@@ -287,21 +416,15 @@ class mimeType {
    *     token := 1*(any (US-ASCII) CHAR except SPACE, CTLs,
    *                 or tspecials)
    *
+   * The tspecials are listed in http::grammar::classify(), and the lookup
+   * itself goes through the grammar's character class table.
+   *
    * @return Reports whether the character is a valid character in a token.
    */
   static bool isToken(int c) {
-    return is7Bit(c) && c != ' ' && !isCTL(c) && !isTSpecial(c);
+    return http::grammar::is(static_cast<unsigned char>(c),
+                             http::grammar::ccMimeToken);
   }
-
-  /* Check whether the character is linear white space.
-   * @c The character to check.
-   *
-   * Linear white space for the purposes of parsing things contained in header
-   * fields is basically spaces and tab characters.
-   *
-   * @return Reports whether the character is linear white space.
-   */
-  static bool isSpace(int c) { return c == ' ' || c == '\t'; }
 };
 }
 
@@ -15,10 +15,10 @@
 #define CXXHTTP_NEGOTIATE_H
 
 #include <algorithm>
-#include <cmath>
-#include <regex>
+#include <atomic>
 #include <set>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <cxxhttp/mime-type.h>
@@ -144,14 +144,9 @@ class qvalue {
         // if we haven't got a base value yet, use the current segment as such.
         value = s;
       } else if (q == -1) {
-        static const std::regex rx("q\\s*=\\s*([01](\\.[0-9]{0,3})?)");
-        std::smatch matches;
-        // parse a q-value, if the current segment is one.
-        if (std::regex_match(s, matches, rx)) {
-          float f = std::stof(matches[1]);
-          q = std::floor(f * 1000);
-        } else {
-          // append to the normal types attributes if not.
+        // parse a q-value, if the current segment is one, and append to the
+        // normal types attributes if not.
+        if (!parseQuality(s, q)) {
           attributes.insert(s);
         }
       } else {
@@ -253,6 +248,19 @@ class qvalue {
       return false;
     }
 
+    return precedes(b);
+  }
+
+  /* Order qvalues, ignoring the quality value.
+   * @b The value to compare to.
+   *
+   * The tie breakers of operator<(), for when the q-values are known to be the
+   * same, or are being replaced, as they are in negotiate().
+   *
+   * @return true if the value is less specific than b's value, or, failing
+   * that, sorts lexically before it.
+   */
+  bool precedes(const qvalue &b) const {
     if (mime.valid() && b.mime.valid()) {
       return mime < b.mime;
     }
@@ -264,8 +272,17 @@ class qvalue {
     }
 
     // We couldn't find out which is less than the other, so just default to
-    // lexical sorting of the recombined string.
-    return std::string(*this) < std::string(b);
+    // lexical sorting of the recombined string. The comparison walks both
+    // sides' pieces, so the recombined strings never need to be built.
+    recombined i(*this), j(b);
+    for (;;) {
+      const int c = i.next(), d = j.next();
+      if (c != d) {
+        return c < d;
+      } else if (c < 0) {
+        return false;
+      }
+    }
   }
 
   /* Report whether two qvalue values match.
@@ -313,11 +330,122 @@ class qvalue {
    * @return 'true' if the value has a wildcard.
    */
   bool wildcard(void) const { return value == "*" || mime.wildcard(); }
+
+ protected:
+  /* Parse a q-value attribute.
+   * @s The attribute, e.g. "q=0.5".
+   * @q Where to put the quality value, in thousandths.
+   *
+   * Accepts "q", optional whitespace, "=", optional whitespace, and a number
+   * from 0 to 1 with up to three decimal places, which are read as an integer
+   * directly rather than going through a float.
+   *
+   * @return 'true' if `s` was a q-value, in which case `q` has been updated.
+   */
+  static bool parseQuality(const stringView &s, int &q) {
+    using http::grammar::isDigit;
+    using http::grammar::isWhitespace;
+
+    std::size_t i = 1;
+    if (s.size() < 3 || s[0] != 'q') {
+      return false;
+    }
+    while (i < s.size() && isWhitespace(s[i])) {
+      i++;
+    }
+    if (i == s.size() || s[i] != '=') {
+      return false;
+    }
+    do {
+      i++;
+    } while (i < s.size() && isWhitespace(s[i]));
+    if (i == s.size() || (s[i] != '0' && s[i] != '1')) {
+      return false;
+    }
+
+    int v = (s[i++] - '0') * 1000;
+    if (i < s.size()) {
+      if (s[i++] != '.' || s.size() - i > 3) {
+        return false;
+      }
+      for (int scale = 100; i < s.size(); i++, scale /= 10) {
+        if (!isDigit(s[i])) {
+          return false;
+        }
+        v += (s[i] - '0') * scale;
+      }
+    }
+
+    q = v;
+    return true;
+  }
+
+  /* Recombined value, one character at a time.
+   *
+   * Produces the same characters as the std::string conversion operator, but
+   * reads them straight out of the value and its attributes.
+   */
+  class recombined {
+   public:
+    /* Construct with a value.
+     * @pValue The qvalue to recombine.
+     */
+    recombined(const qvalue &pValue)
+        : value(pValue),
+          attribute(pValue.attributes.begin()),
+          piece(&pValue.value),
+          pos(0) {}
+
+    /* Get the next character.
+     *
+     * @return The next character, as an unsigned char, or -1 at the end.
+     */
+    int next(void) {
+      if (pos < piece->size()) {
+        return static_cast<unsigned char>((*piece)[pos++]);
+      }
+      if (value.value.empty() || attribute == value.attributes.end()) {
+        return -1;
+      }
+      piece = &*(attribute++);
+      pos = 0;
+      return ';';
+    }
+
+   protected:
+    /* The value being recombined. */
+    const qvalue &value;
+
+    /* The next attribute to produce. */
+    std::set<std::string>::const_iterator attribute;
+
+    /* The value or attribute currently being produced. */
+    const std::string *piece;
+
+    /* Position in <piece>. */
+    std::size_t pos;
+  };
 };
 
-/* Negotiate with quality-value.
- * @theirs The client's list of acceptable values.
- * @mine The server's list of acceptable values.
+/* Parse and sort a list of qvalues.
+ * @list The split list, e.g. from split().
+ *
+ * Sorts the same way a std::set<qvalue> would, i.e. by qvalue::operator<, and
+ * keeps equivalent values in their original order, which is what a std::set
+ * would keep the first of. Duplicates aren't removed, which doesn't change the
+ * outcome of a negotiation.
+ *
+ * @return The parsed qvalues, in ascending order.
+ */
+static inline std::vector<qvalue> sorted(const std::vector<std::string> &list) {
+  std::vector<qvalue> rv(list.begin(), list.end());
+  std::stable_sort(rv.begin(), rv.end());
+  return rv;
+}
+
+/* Negotiate with sorted quality-values.
+ * @theirs The client's list of acceptable values, in ascending order.
+ * @mine The server's list of acceptable values, in ascending order.
  *
  * Implements the HTTP/1.1 content negotiation as described in RFC 2616, section
  * 14. See the RFC for extra details.
@@ -333,12 +461,16 @@ class qvalue {
  * mean that there's a match between both sides in principle, but nothing is
  * returned because of wildcards on both sides.
  *
+ * Both lists can be any container of qvalues, as long as it's sorted like a
+ * std::set<qvalue> would be.
+ *
  * See: https://www.w3.org/Protocols/rfc2616/rfc2616-sec14.html#sec14.1
  *
  * @return The negotiated value.
  */
-static inline std::string negotiate(std::set<qvalue> theirs,
-                                    std::set<qvalue> mine) {
+template <typename theirsList, typename mineList>
+static inline std::string negotiateSorted(const theirsList &theirs,
+                                          const mineList &mine) {
   if (mine.size() == 0) {
     // this branch indicates a programming error on the server side. There's no
     // use in negotiating the content if we don't know what we want.
@@ -348,11 +480,10 @@ static inline std::string negotiate(std::set<qvalue> theirs,
   if (theirs.size() == 0) {
     // the user didn't specify anything, so go with the highest-preference on
     // our side.
-    std::vector<qvalue> rev(mine.rbegin(), mine.rend());
-    for (const auto &v : rev) {
-      if (!v.wildcard()) {
+    for (auto v = mine.rbegin(); v != mine.rend(); v++) {
+      if (!v->wildcard()) {
         // only return a value if there's no wildcards.
-        return v;
+        return *v;
       }
     }
 
@@ -361,65 +492,72 @@ static inline std::string negotiate(std::set<qvalue> theirs,
     return "";
   }
 
-  std::set<qvalue> is;
+  const qvalue *best = nullptr;
+  int bestQ = 0;
 
-  // this is to intersect the two sets. We can't use std::set_intersect, because
-  // we also need to recalculate the q-values.
+  // this is to intersect the two lists, but all we need is the best match in
+  // the intersection, so that's all that's kept. A later match only replaces
+  // an earlier one if it's strictly better, which picks the same value that
+  // inserting all matches into a std::set and taking the last would.
   for (const auto &a : theirs) {
     for (const auto &b : mine) {
       if (a == b) {
         // Combined q-value. Combining like this allows for server-side q-value
         // influences.
-        int q = a.q * b.q / 1000;
-
-        if (a.wildcard()) {
-          auto qv = b;
-          qv.q = q;
-          is.insert(qv);
-        } else if (b.wildcard()) {
-          auto qv = a;
-          qv.q = q;
-          is.insert(qv);
-        } else {
-          auto qv = b;
-          qv.q = q;
-          is.insert(qv);
+        const int q = a.q * b.q / 1000;
+        const qvalue &v = (b.wildcard() && !a.wildcard()) ? a : b;
+
+        if (best == nullptr || bestQ < q ||
+            (bestQ == q && best->precedes(v))) {
+          best = &v;
+          bestQ = q;
         }
       }
     }
   }
 
-  if (is.size() == 0) {
+  if (best == nullptr) {
     // no matches between the two sets, so... oops.
     return "";
   }
 
-  // since everything was sorted, and only matches are left, the highest-quality
-  // value is the one we want.
-  return *(is.rbegin());
+  return *best;
 }
 
 /* Negotiate with quality-value.
  * @theirs The client's list of acceptable values.
  * @mine The server's list of acceptable values.
  *
- * This is the std::vector version of the negotiation function. See the std::set
- * variant for more details on the algorithm.
+ * This is the std::set version of the negotiation function. See
+ * negotiateSorted() for more details on the algorithm.
  *
  * @return The negotiated value.
  */
-static inline std::string negotiate(std::vector<std::string> theirs,
-                                    std::vector<std::string> mine) {
-  return negotiate(std::set<qvalue>(theirs.begin(), theirs.end()),
-                   std::set<qvalue>(mine.begin(), mine.end()));
+static inline std::string negotiate(const std::set<qvalue> &theirs,
+                                    const std::set<qvalue> &mine) {
+  return negotiateSorted(theirs, mine);
 }
 
 /* Negotiate with quality-value.
  * @theirs The client's list of acceptable values.
  * @mine The server's list of acceptable values.
  *
- * This is the string version of the negotiation function. See the std::set
- * variant for more details on the algorithm.
+ * This is the std::vector version of the negotiation function. See
+ * negotiateSorted() for more details on the algorithm.
+ *
+ * @return The negotiated value.
+ */
+static inline std::string negotiate(const std::vector<std::string> &theirs,
+                                    const std::vector<std::string> &mine) {
+  return negotiateSorted(sorted(theirs), sorted(mine));
+}
+
+/* Negotiate with quality-value.
+ * @theirs The client's list of acceptable values.
+ * @mine The server's list of acceptable values.
+ *
+ * This is the string version of the negotiation function. See
+ * negotiateSorted() for more details on the algorithm.
  *
  * @return The negotiated value.
  */
@@ -427,6 +565,183 @@ static inline std::string negotiate(const std::string &theirs,
                                     const std::string &mine) {
   return negotiate(split(theirs), split(mine));
 }
+
+/* Pre-parsed negotiation values.
+ *
+ * The server's side of a negotiation is usually always the same, so there's no
+ * need to parse it again for every request. This keeps it in the form that the
+ * negotiation algorithm needs, along with the result of negotiating with a
+ * client that doesn't say what it wants.
+ *
+ * Clients also tend to send the same few headers over and over, so results
+ * are remembered by the client's header value. Negotiators are shared between
+ * all the sessions, threads and shards of a server, so each thread remembers
+ * results on its own, which means no locks when negotiating.
+ */
+class negotiator {
+ public:
+  /* Construct with the server's values.
+   * @mine The server's list of acceptable values.
+   */
+  negotiator(const std::string &mine) : id(++ids()) {
+    const auto v = split(mine);
+    values = std::set<qvalue>(v.begin(), v.end());
+    preferred = negotiateSorted(std::vector<qvalue>(), values);
+  }
+
+  /* Copy constructor.
+   * @n The negotiator to copy.
+   *
+   * Copies the server's values and settings, but not the remembered results
+   * or the number of hits and misses.
+   */
+  negotiator(const negotiator &n)
+      : values(n.values),
+        preferred(n.preferred),
+        cacheSize(n.cacheSize),
+        id(++ids()) {}
+
+  /* Copy assignment.
+   * @n The negotiator to copy.
+   *
+   * Like the copy constructor, this forgets any remembered results, and
+   * starts counting hits and misses again.
+   *
+   * @return This negotiator.
+   */
+  negotiator &operator=(const negotiator &n) {
+    values = n.values;
+    preferred = n.preferred;
+    cacheSize = n.cacheSize;
+    id = ++ids();
+    hitCount = 0;
+    missCount = 0;
+    return *this;
+  }
+
+  /* The server's values, parsed and sorted. */
+  std::set<qvalue> values;
+
+  /* What to use if the client has no preference. */
+  std::string preferred;
+
+  /* Maximum number of remembered results.
+   *
+   * Once a thread remembers this many results, it forgets all of them, which
+   * keeps a client sending lots of different headers from using up memory.
+   * Set to 0 to not remember anything.
+   */
+  std::size_t cacheSize = 64;
+
+  /* Number of negotiations with a remembered result.
+   *
+   * @return How many negotiations had one, on any thread.
+   */
+  std::size_t hits(void) const { return hitCount; }
+
+  /* Number of negotiations that had to be done in full.
+   *
+   * @return How many negotiations had to be, on any thread.
+   */
+  std::size_t misses(void) const { return missCount; }
+
+  /* Negotiate.
+   * @theirs The client's list of acceptable values.
+   *
+   * Looks up the result for `theirs`, or negotiates and remembers it if it's
+   * not known yet. Only the client's side needs to be parsed for that, and
+   * only if it's given at all.
+   *
+   * @return The negotiated value.
+   */
+  std::string negotiate(const std::string &theirs) const {
+    if (theirs.empty()) {
+      return preferred;
+    }
+
+    remembered &l = local();
+    const auto it = l.results.find(theirs);
+    if (it != l.results.end()) {
+      hitCount++;
+      return it->second;
+    }
+    missCount++;
+
+    const std::string r = negotiateSorted(sorted(split(theirs)), values);
+
+    if (cacheSize > 0) {
+      if (l.results.size() >= cacheSize) {
+        l.results.clear();
+      }
+      l.results[theirs] = r;
+    }
+    return r;
+  }
+
+ protected:
+  /* A thread's remembered results. */
+  struct remembered {
+    /* Remembered results, by the client's header value. */
+    std::unordered_map<std::string, std::string> results;
+  };
+
+  /* Number of negotiations with a remembered result, on all threads. */
+  mutable std::atomic<std::size_t> hitCount{0};
+
+  /* Number of negotiations that had to be done in full, on all threads. */
+  mutable std::atomic<std::size_t> missCount{0};
+
+  /* Maximum number of negotiators a thread remembers results for.
+   *
+   * Results aren't forgotten when a negotiator goes away, as that would mean
+   * going through every thread. Instead, each thread forgets everything once
+   * it remembers results for this many negotiators.
+   */
+  enum : std::size_t { maxNegotiators = 1024 };
+
+  /* Unique ID, to find the calling thread's results with.
+   *
+   * Not the negotiator's address, as a new negotiator could end up with the
+   * same address as one that's gone.
+   */
+  std::size_t id;
+
+  /* Negotiator IDs.
+   *
+   * @return The last negotiator ID that was handed out.
+   */
+  static std::atomic<std::size_t> &ids(void) {
+    static std::atomic<std::size_t> last{0};
+    return last;
+  }
+
+  /* The calling thread's results.
+   *
+   * @return The results that the calling thread remembers for this negotiator.
+   */
+  remembered &local(void) const {
+    thread_local std::unordered_map<std::size_t, remembered> all;
+    if (all.size() >= maxNegotiators && all.find(id) == all.end()) {
+      all.clear();
+    }
+    return all[id];
+  }
+};
+
+/* Negotiate with quality-value.
+ * @theirs The client's list of acceptable values.
+ * @mine The server's pre-parsed values.
+ *
+ * Like the string version of the negotiation function, but only the client's
+ * side needs to be parsed, and the result may already be known; see
+ * negotiator::negotiate().
+ *
+ * @return The negotiated value.
+ */
+static inline std::string negotiate(const std::string &theirs,
+                                    const negotiator &mine) {
+  return mine.negotiate(theirs);
+}
 }
 
 #endif
@@ -14,8 +14,13 @@
 #if !defined(CXXHTTP_NETWORK_H)
 #define CXXHTTP_NETWORK_H
 
+#include <atomic>
+#include <deque>
 #include <iostream>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
 #define ASIO_STANDALONE
 #include <asio.hpp>
@@ -23,6 +28,11 @@
 #include <ef.gy/cli.h>
 #include <ef.gy/global.h>
 
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 namespace cxxhttp {
 /* asio::io_service type.
  *
@@ -37,19 +47,169 @@ using service = asio::io_service;
 #define IO_MAIN_SPEC static inline
 #endif
 
+/* Number of threads to run the I/O service on.
+ *
+ * Set with the `threads` CLI option. Sessions keep their handlers on a strand,
+ * so each of them is still only worked on by one thread at a time.
+ */
+static std::size_t threads = 1;
+
+#if !defined(ASIO_DISABLE_THREADS)
+/* Thread count CLI option.
+ *
+ * The format is `threads:(count)`, or `--threads=(count)`. Only available if
+ * ASIO was built with thread support, i.e. without ASIO_DISABLE_THREADS.
+ */
+static efgy::cli::option threadsOption(
+    "-{0,2}threads[:=]([0-9]+)",
+    [](std::smatch &m) -> bool {
+      threads = std::stoul(m[1]);
+      return threads > 0;
+    },
+    "run the I/O service on this many threads[1]; defaults to 1");
+#endif
+
+/* Number of shards to run.
+ *
+ * Set with the `shards` CLI option. Each shard is an I/O service of its own,
+ * with its own thread or threads, and TCP servers that are set up on the
+ * command line get a listener on each of them.
+ */
+static std::size_t shards = 1;
+
+#if !defined(ASIO_DISABLE_THREADS)
+/* Shard count CLI option.
+ *
+ * The format is `shards:(count)`, or `--shards=(count)`. This only affects TCP
+ * servers that are set up after it on the command line, so it needs to come
+ * first. Only available if ASIO was built with thread support.
+ */
+static efgy::cli::option shardsOption(
+    "-{0,2}shards[:=]([0-9]+)",
+    [](std::smatch &m) -> bool {
+      shards = std::stoul(m[1]);
+      return shards > 0;
+    },
+    "run this many[1] independent I/O services; defaults to 1");
+#endif
+
+/* Get a shard's I/O service.
+ * @pShard Which shard to get the service of.
+ *
+ * Shard 0 is the global I/O service, the others are created the first time
+ * they're asked for. This is not thread safe, and should only be used while
+ * setting things up, before run() is called.
+ *
+ * @return The I/O service for the shard.
+ */
+static inline service &shard(std::size_t pShard) {
+  if (pShard == 0) {
+    return efgy::global<service>();
+  }
+
+  auto &services = efgy::global<std::deque<service>>();
+  while (services.size() < pShard) {
+    services.emplace_back();
+  }
+  return services[pShard - 1];
+}
+
+/* Pin the calling thread to a core.
+ * @pCore The core to pin to; wraps around if there aren't that many.
+ *
+ * Only does anything on Linux. Failures are ignored, as this is only ever a
+ * hint to the scheduler and not something we depend on.
+ */
+static inline void pin(std::size_t pCore) {
+#if defined(__linux__)
+  const std::size_t cores = std::thread::hardware_concurrency();
+  if (cores > 0) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(pCore % cores, &set);
+    (void)pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  }
+#endif
+}
+
+/* Run an I/O service.
+ * @pService The I/O service to run.
+ * @pThreads How many threads to run it on.
+ *
+ * Runs the service on the calling thread and `pThreads - 1` others, and waits
+ * for all of them to run out of work. With ASIO_DISABLE_THREADS, the service is
+ * only ever run on the calling thread.
+ */
+static inline void run(service &pService, std::size_t pThreads = threads) {
+  std::vector<std::thread> pool;
+#if !defined(ASIO_DISABLE_THREADS)
+  for (std::size_t i = 1; i < pThreads; i++) {
+    pool.emplace_back([&pService] { pService.run(); });
+  }
+#endif
+
+  pService.run();
+
+  for (auto &t : pool) {
+    t.join();
+  }
+}
+
+/* Run all shards.
+ * @pShards How many shards to run.
+ * @pThreads How many threads to run each shard on.
+ *
+ * Runs every shard's I/O service with run(), each on a thread of its own, and
+ * shard 0 on the calling thread. If there's more than one shard and they each
+ * only have the one thread, then those threads are pinned to a core each.
+ */
+static inline void run(std::size_t pShards, std::size_t pThreads = threads) {
+  const bool pinned = pShards > 1 && pThreads == 1;
+
+  // shard() isn't thread safe, so make sure every shard exists before any of
+  // the threads get to them.
+  std::vector<service *> services;
+  for (std::size_t i = 0; i < pShards; i++) {
+    services.push_back(&shard(i));
+  }
+
+  std::vector<std::thread> pool;
+#if !defined(ASIO_DISABLE_THREADS)
+  for (std::size_t i = 1; i < pShards; i++) {
+    service &s = *services[i];
+    pool.emplace_back([i, &s, pinned, pThreads] {
+      if (pinned) {
+        pin(i);
+      }
+      run(s, pThreads);
+    });
+  }
+#endif
+
+  if (pinned) {
+    pin(0);
+  }
+  run(*services[0], pThreads);
+
+  for (auto &t : pool) {
+    t.join();
+  }
+}
+
 /* Default IO main function.
  * @argc Argument count.
  * @argv Argument vector.
  *
  * Applies all arguments with the efgy::cli facilities, then (tries to) run an
- * ASIO I/O loop.
+ * ASIO I/O loop for as many shards as the `shards` option asks for, each on as
+ * many threads as the `threads` option asks for.
  *
  * @return 0 on success, -1 on failure.
  */
 IO_MAIN_SPEC int main(int argc, char *argv[]) {
   efgy::cli::options opts(argc, argv);
 
-  efgy::global<service>().run();
+  run(shards);
 
   return opts.matches == 0 ? -1 : 0;
 }
@@ -166,6 +326,28 @@ class endpoint<transport::tcp> {
   cxxhttp::service &service;
 };
 
+/* Allow several sockets to listen on the same port.
+ * @acceptor An acceptor type that doesn't support this.
+ *
+ * Does nothing; only TCP has a use for this.
+ */
+template <typename acceptor>
+static inline void reusePort(acceptor &) {}
+
+/* Allow several TCP sockets to listen on the same port.
+ * @pAcceptor An opened, but not yet bound, TCP acceptor.
+ *
+ * Sets SO_REUSEPORT, where available, so that shards can each bind their own
+ * socket to the same port. The kernel then spreads incoming connections over
+ * all of those sockets.
+ */
+static inline void reusePort(transport::tcp::acceptor &pAcceptor) {
+#if defined(SO_REUSEPORT)
+  pAcceptor.set_option(
+      asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true));
+#endif
+}
+
 /* Basic asynchronous connection wrapper
  * @session The session type. We need this as they're registered.
  * @requestProcessor The class of something that can handle requests.
@@ -201,15 +383,33 @@ class connection {
    * Initially set to true, but reset to false if, for whatever reason, there
    * are no more pending connections for the given session.
    */
-  bool pending;
+  std::atomic<bool> pending;
 
   /* Active sessions.
    *
    * The sessions that are currently active. This list is maintained using a
-   * beaon in the session object.
+   * beaon in the session object. Sessions are only added by getSession(), and
+   * anything that looks at the list while the connection is in use must hold
+   * <lock>.
    */
   efgy::beacons<session> sessions;
 
+  /* Maximum number of pooled sessions.
+   *
+   * Free sessions are kept around for reuse, up to this many. Any beyond that
+   * are deleted once they're free. Set this before running the I/O service.
+   */
+  std::size_t maxPooled = 1024;
+
+  /* Number of sessions that getSession() created. */
+  std::atomic<std::size_t> created;
+
+  /* Number of sessions that getSession() took from the pool. */
+  std::atomic<std::size_t> reused;
+
+  /* Number of free sessions that didn't fit in the pool. */
+  std::atomic<std::size_t> discarded;
+
   /* Initialise with IO service.
    * @pio IO service to use.
    * @pConnections The root of the connection set to register with.
@@ -220,7 +420,13 @@ class connection {
   connection(efgy::beacons<connection> &pConnections =
                  efgy::global<efgy::beacons<connection>>(),
              service &pio = efgy::global<service>())
-      : io(pio), pending(false), acceptor(pio), beacon(*this, pConnections) {}
+      : io(pio),
+        pending(false),
+        created(0),
+        reused(0),
+        discarded(0),
+        acceptor(pio),
+        beacon(*this, pConnections) {}
 
   /* Initialise with IO service and endpoint.
    * @endpoint Where to connect to, or listen on.
@@ -235,6 +441,9 @@ class connection {
              service &pio = efgy::global<service>())
       : io(pio),
         pending(true),
+        created(0),
+        reused(0),
+        discarded(0),
         acceptor(pio),
         target(endpoint),
         beacon(*this, pConnections) {
@@ -269,6 +478,8 @@ class connection {
                          efgy::beacons<connection> &pConnections =
                              efgy::global<efgy::beacons<connection>>(),
                          service &pio = efgy::global<service>()) {
+    static std::mutex registry;
+    std::lock_guard<std::mutex> guard(registry);
     connection *idle = 0;
 
     for (auto &c : pConnections) {
@@ -322,16 +533,14 @@ class connection {
    * Used when trying to find a connection to reuse. This determines whether the
    * connection can just be reused directly, without further processing.
    *
+   * A connection is idle if it isn't pending and all of its sessions are in the
+   * pool, so this doesn't need to look at the sessions themselves.
+   *
    * @return Whether the session can be reused.
    */
   bool idle(void) const {
-    bool isIdle = !pending;
-
-    for (const auto &s : sessions) {
-      isIdle = isIdle && s->free;
-    }
-
-    return isIdle;
+    std::lock_guard<std::mutex> guard(lock);
+    return !pending && pooled.size() == sessions.size();
   }
 
   /* Query local endpoint.
@@ -355,12 +564,15 @@ class connection {
    *
    * @return Whether the connection is still active or not.
    */
-  bool active(void) const { return pending || sessions.size() > 0; }
+  bool active(void) const {
+    std::lock_guard<std::mutex> guard(lock);
+    return pending || sessions.size() > 0;
+  }
 
   /* Get a free session.
    *
-   * Steps through all sessions to obtain a free one, If no sessions are free,
-   * this will instead return a brand new one.
+   * Takes the most recently released session from the pool. If the pool is
+   * empty, this will instead return a brand new one.
    *
    * This allows recycling sessions, which in turn means we don't have to do
    * ugly things like kill sessions ourselves.
@@ -368,17 +580,73 @@ class connection {
    * @return A free session, or null.
    */
   session *getSession(void) {
-    for (auto &sess : sessions) {
-      if (sess->free) {
-        sess->free = false;
-        return sess;
-      }
+    std::lock_guard<std::mutex> guard(lock);
+    if (!pooled.empty()) {
+      session *sess = pooled.back();
+      pooled.pop_back();
+      sess->free = false;
+      reused++;
+      return sess;
     }
 
+    created++;
     return new session(*this);
   }
 
+  /* Return a session to the pool.
+   * @sess A session that's done with its connection.
+   *
+   * Tags the session as free and pools it, if there's room. Otherwise, the
+   * session should be deleted with discard().
+   *
+   * @return 'true' if the session was pooled.
+   */
+  bool release(session *sess) {
+    std::lock_guard<std::mutex> guard(lock);
+    sess->free = true;
+    if (pooled.size() >= maxPooled) {
+      return false;
+    }
+
+    pooled.push_back(sess);
+    return true;
+  }
+
+  /* Delete a session that didn't fit in the pool.
+   * @sess The session to delete. Must be free, and not pooled.
+   *
+   * Holds <lock> while the session removes itself from <sessions>.
+   */
+  void discard(session *sess) {
+    std::lock_guard<std::mutex> guard(lock);
+    discarded++;
+    delete sess;
+  }
+
+  /* Number of pooled sessions.
+   *
+   * @return How many free sessions are waiting to be reused.
+   */
+  std::size_t pooledSessions(void) const {
+    std::lock_guard<std::mutex> guard(lock);
+    return pooled.size();
+  }
+
  protected:
+  /* Session list lock.
+   *
+   * Guards <sessions> and <pooled>, which sessions running on other threads may
+   * otherwise change while they're being looked at.
+   */
+  mutable std::mutex lock;
+
+  /* Free sessions.
+   *
+   * Sessions are pushed here by release() and popped again by getSession(), so
+   * that neither needs to look through all of <sessions>. Guarded by <lock>.
+   */
+  std::vector<session *> pooled;
+
   /* Socket acceptor
    *
    * This is the acceptor which has been bound to the socket specified in the
@@ -401,11 +669,15 @@ class connection {
   /* Start accepting connections or connecting.
    *
    * Queries the processor to find out whether we should listen or connect to
-   * the target, then does that.
+   * the target, then does that. With more than one shard, listening sockets
+   * are set up so that each shard can have its own on the same port.
    */
   void start(void) {
     if (processor.listen()) {
       acceptor.open(target.protocol());
+      if (shards > 1) {
+        reusePort(acceptor);
+      }
       acceptor.bind(target);
       acceptor.listen();
       startAccept();
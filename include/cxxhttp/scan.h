@@ -0,0 +1,338 @@
+/* Delimiter scanning.
+ *
+ * Finding line ends, colons and spaces is most of what it takes to split up an
+ * HTTP header, and with large headers that gets to be a noticeable part of the
+ * time we spend on a request. The functions in here use SSE2 or AVX2 to look at
+ * 16 or 32 bytes at a time, if the CPU we're running on supports that, and a
+ * plain loop otherwise. The same goes for looking for control characters, which
+ * is how we check that header values are valid.
+ *
+ * Define NO_SIMD to always use the plain loop.
+ *
+ * See also:
+ * * Project Documentation: https://ef.gy/documentation/cxxhttp
+ * * Project Source Code: https://github.com/ef-gy/cxxhttp
+ * * Licence Terms: https://github.com/ef-gy/cxxhttp/blob/master/COPYING
+ *
+ * @copyright
+ * This file is part of the cxxhttp project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ */
+#if !defined(CXXHTTP_SCAN_H)
+#define CXXHTTP_SCAN_H
+
+#include <cstddef>
+
+#include <cxxhttp/string.h>
+
+#if !defined(NO_SIMD) && defined(__GNUC__) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define CXXHTTP_SCAN_X86
+#include <immintrin.h>
+#endif
+
+namespace cxxhttp {
+namespace scan {
+/* Delimiter search function type.
+ *
+ * All of the implementations below have this signature: given a buffer and its
+ * size, return the position of the first byte that is either `a` or `b`, or
+ * stringView::npos if there is no such byte.
+ */
+using finder = std::size_t (*)(const char *data, std::size_t size, char a,
+                               char b);
+
+/* Find delimiter, one byte at a time.
+ * @data Start of the buffer to search.
+ * @size Size of the buffer to search.
+ * @a The first delimiter to look for.
+ * @b The second delimiter to look for; may be the same as `a`.
+ *
+ * This is the fallback for when there's no vector unit to use, and used by the
+ * other implementations for any left-over bytes.
+ *
+ * @return Position of the first `a` or `b`, or stringView::npos.
+ */
+static inline std::size_t findScalar(const char *data, std::size_t size,
+                                     char a, char b) {
+  for (std::size_t i = 0; i < size; i++) {
+    if (data[i] == a || data[i] == b) {
+      return i;
+    }
+  }
+  return stringView::npos;
+}
+
+#if defined(CXXHTTP_SCAN_X86) && defined(__SSE2__)
+/* Find delimiter, 16 bytes at a time.
+ * @data Start of the buffer to search.
+ * @size Size of the buffer to search.
+ * @a The first delimiter to look for.
+ * @b The second delimiter to look for; may be the same as `a`.
+ *
+ * SSE2 is part of the base instruction set on x86-64, so if this is compiled
+ * in it can always be used.
+ *
+ * @return Position of the first `a` or `b`, or stringView::npos.
+ */
+static inline std::size_t findSSE2(const char *data, std::size_t size,
+                                   char a, char b) {
+  const __m128i va = _mm_set1_epi8(a);
+  const __m128i vb = _mm_set1_epi8(b);
+  std::size_t i = 0;
+
+  for (; i + 16 <= size; i += 16) {
+    const __m128i v =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+    const int m = _mm_movemask_epi8(
+        _mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)));
+    if (m != 0) {
+      return i + __builtin_ctz(m);
+    }
+  }
+
+  const std::size_t r = findScalar(data + i, size - i, a, b);
+  return r == stringView::npos ? r : i + r;
+}
+#endif
+
+#if defined(CXXHTTP_SCAN_X86)
+/* Find delimiter, 32 bytes at a time.
+ * @data Start of the buffer to search.
+ * @size Size of the buffer to search.
+ * @a The first delimiter to look for.
+ * @b The second delimiter to look for; may be the same as `a`.
+ *
+ * Compiled for AVX2 regardless of the target flags, and only used if the CPU
+ * says it supports AVX2 at run time.
+ *
+ * @return Position of the first `a` or `b`, or stringView::npos.
+ */
+__attribute__((target("avx2"))) static inline std::size_t findAVX2(
+    const char *data, std::size_t size, char a, char b) {
+  const __m256i va = _mm256_set1_epi8(a);
+  const __m256i vb = _mm256_set1_epi8(b);
+  std::size_t i = 0;
+
+  for (; i + 32 <= size; i += 32) {
+    const __m256i v =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+    const unsigned m = _mm256_movemask_epi8(
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, va), _mm256_cmpeq_epi8(v, vb)));
+    if (m != 0) {
+      return i + __builtin_ctz(m);
+    }
+  }
+
+  const std::size_t r = findScalar(data + i, size - i, a, b);
+  return r == stringView::npos ? r : i + r;
+}
+#endif
+
+/* Pick the best delimiter search for this CPU.
+ *
+ * @return The fastest implementation that the CPU supports.
+ */
+static inline finder best(void) {
+#if defined(CXXHTTP_SCAN_X86)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return findAVX2;
+  }
+#endif
+#if defined(CXXHTTP_SCAN_X86) && defined(__SSE2__)
+  return findSSE2;
+#else
+  return findScalar;
+#endif
+}
+
+/* Find either of two delimiters.
+ * @text The text to search.
+ * @a The first delimiter to look for.
+ * @b The second delimiter to look for.
+ * @pos Where to start looking.
+ *
+ * @return Position of the first `a` or `b` at or after `pos`, or
+ * stringView::npos if there is none.
+ */
+static inline std::size_t findEither(const stringView &text, char a, char b,
+                                     std::size_t pos = 0) {
+  static const finder impl = best();
+
+  if (pos >= text.size()) {
+    return stringView::npos;
+  }
+
+  const std::size_t r = impl(text.data() + pos, text.size() - pos, a, b);
+  return r == stringView::npos ? r : pos + r;
+}
+
+/* Find a delimiter.
+ * @text The text to search.
+ * @c The delimiter to look for.
+ * @pos Where to start looking.
+ *
+ * @return Position of the first `c` at or after `pos`, or stringView::npos if
+ * there is none.
+ */
+static inline std::size_t find(const stringView &text, char c,
+                               std::size_t pos = 0) {
+  return findEither(text, c, c, pos);
+}
+
+/* Find the end of a header block.
+ * @text The text to search, starting with the start line.
+ *
+ * A header block ends with an empty line, so we're looking for a newline that
+ * is followed by either another newline or by a CRLF.
+ *
+ * @return Position right after the empty line, or stringView::npos if the
+ * header block is not complete.
+ */
+static inline std::size_t headerEnd(const stringView &text) {
+  for (std::size_t i = find(text, '\n'); i != stringView::npos;
+       i = find(text, '\n', i + 1)) {
+    std::size_t n = i + 1;
+    if (n < text.size() && text[n] == '\r') {
+      n++;
+    }
+    if (n < text.size() && text[n] == '\n') {
+      return n + 1;
+    }
+  }
+  return stringView::npos;
+}
+
+/* Control character search function type.
+ *
+ * Given a buffer and its size, return the position of the first control
+ * character in it, or stringView::npos if there is none. Horizontal tabs do not
+ * count as control characters for this purpose, but DEL does.
+ */
+using controlFinder = std::size_t (*)(const char *data, std::size_t size);
+
+/* Is this a control character?
+ * @c The character to check.
+ *
+ * @return 'true' if `c` is a control character other than a horizontal tab.
+ */
+static inline bool isControl(unsigned char c) {
+  return (c < 0x20 && c != '\t') || c == 0x7f;
+}
+
+/* Find control character, one byte at a time.
+ * @data Start of the buffer to search.
+ * @size Size of the buffer to search.
+ *
+ * @return Position of the first control character, or stringView::npos.
+ */
+static inline std::size_t findControlScalar(const char *data,
+                                            std::size_t size) {
+  for (std::size_t i = 0; i < size; i++) {
+    if (isControl(data[i])) {
+      return i;
+    }
+  }
+  return stringView::npos;
+}
+
+#if defined(CXXHTTP_SCAN_X86) && defined(__SSE2__)
+/* Find control character, 16 bytes at a time.
+ * @data Start of the buffer to search.
+ * @size Size of the buffer to search.
+ *
+ * There's no unsigned byte comparison in SSE2, but if the smaller of a byte and
+ * 0x1f is the byte itself, then the byte is at most 0x1f.
+ *
+ * @return Position of the first control character, or stringView::npos.
+ */
+static inline std::size_t findControlSSE2(const char *data, std::size_t size) {
+  const __m128i low = _mm_set1_epi8(0x1f);
+  const __m128i tab = _mm_set1_epi8('\t');
+  const __m128i del = _mm_set1_epi8(0x7f);
+  std::size_t i = 0;
+
+  for (; i + 16 <= size; i += 16) {
+    const __m128i v =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+    const __m128i c = _mm_andnot_si128(
+        _mm_cmpeq_epi8(v, tab), _mm_cmpeq_epi8(_mm_min_epu8(v, low), v));
+    const int m = _mm_movemask_epi8(_mm_or_si128(c, _mm_cmpeq_epi8(v, del)));
+    if (m != 0) {
+      return i + __builtin_ctz(m);
+    }
+  }
+
+  const std::size_t r = findControlScalar(data + i, size - i);
+  return r == stringView::npos ? r : i + r;
+}
+#endif
+
+#if defined(CXXHTTP_SCAN_X86)
+/* Find control character, 32 bytes at a time.
+ * @data Start of the buffer to search.
+ * @size Size of the buffer to search.
+ *
+ * The AVX2 version of findControlSSE2(); only used if the CPU supports it.
+ *
+ * @return Position of the first control character, or stringView::npos.
+ */
+__attribute__((target("avx2"))) static inline std::size_t findControlAVX2(
+    const char *data, std::size_t size) {
+  const __m256i low = _mm256_set1_epi8(0x1f);
+  const __m256i tab = _mm256_set1_epi8('\t');
+  const __m256i del = _mm256_set1_epi8(0x7f);
+  std::size_t i = 0;
+
+  for (; i + 32 <= size; i += 32) {
+    const __m256i v =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+    const __m256i c =
+        _mm256_andnot_si256(_mm256_cmpeq_epi8(v, tab),
+                            _mm256_cmpeq_epi8(_mm256_min_epu8(v, low), v));
+    const unsigned m =
+        _mm256_movemask_epi8(_mm256_or_si256(c, _mm256_cmpeq_epi8(v, del)));
+    if (m != 0) {
+      return i + __builtin_ctz(m);
+    }
+  }
+
+  const std::size_t r = findControlScalar(data + i, size - i);
+  return r == stringView::npos ? r : i + r;
+}
+#endif
+
+/* Pick the best control character search for this CPU.
+ *
+ * @return The fastest implementation that the CPU supports.
+ */
+static inline controlFinder bestControl(void) {
+#if defined(CXXHTTP_SCAN_X86)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return findControlAVX2;
+  }
+#endif
+#if defined(CXXHTTP_SCAN_X86) && defined(__SSE2__)
+  return findControlSSE2;
+#else
+  return findControlScalar;
+#endif
+}
+
+/* Find a control character.
+ * @text The text to search.
+ *
+ * @return Position of the first control character other than a horizontal
+ * tab, or stringView::npos if there is none.
+ */
+static inline std::size_t findControl(const stringView &text) {
+  static const controlFinder impl = bestControl();
+
+  return impl(text.data(), text.size());
+}
+}
+}
+
+#endif
@@ -16,14 +16,212 @@
 #if !defined(CXXHTTP_STRING_H)
 #define CXXHTTP_STRING_H
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include <locale>
+#include <ostream>
 #include <string>
 
 namespace cxxhttp {
+/* Non-owning string reference.
+ *
+ * A pointer and a length, referring to characters that are owned by somebody
+ * else. We use these to pick apart input buffers without copying every single
+ * piece of them into a new std::string first.
+ *
+ * This is a small subset of C++17's std::string_view, as we're still targeting
+ * C++14. Whatever a view refers to must outlive the view itself.
+ */
+class stringView {
+ public:
+  using const_iterator = const char *;
+  using iterator = const_iterator;
+
+  /* Marker for "not found" and "until the end". */
+  static const std::size_t npos = std::string::npos;
+
+  /* Default constructor.
+   *
+   * Creates an empty view.
+   */
+  stringView(void) : start(""), length(0) {}
+
+  /* Construct with pointer and length.
+   * @pData Start of the character data.
+   * @pLength Number of characters to refer to.
+   */
+  stringView(const char *pData, std::size_t pLength)
+      : start(pData), length(pLength) {}
+
+  /* Construct with C string.
+   * @pString NUL-terminated string to refer to.
+   */
+  stringView(const char *pString)
+      : start(pString), length(std::strlen(pString)) {}
+
+  /* Construct with C++ string.
+   * @pString The string to refer to.
+   */
+  stringView(const std::string &pString)
+      : start(pString.data()), length(pString.size()) {}
+
+  const char *data(void) const { return start; }
+  std::size_t size(void) const { return length; }
+  bool empty(void) const { return length == 0; }
+  const_iterator begin(void) const { return start; }
+  const_iterator end(void) const { return start + length; }
+  const char &operator[](std::size_t i) const { return start[i]; }
+  const char &front(void) const { return start[0]; }
+  const char &back(void) const { return start[length - 1]; }
+
+  /* Create sub-view.
+   * @pos Where to start the new view.
+   * @n Maximum number of characters in the new view.
+   *
+   * Positions past the end are clamped, so this never throws.
+   *
+   * @return A view of the given range of this view.
+   */
+  stringView substr(std::size_t pos, std::size_t n = npos) const {
+    pos = std::min(pos, length);
+    return stringView(start + pos, std::min(n, length - pos));
+  }
+
+  /* Find character.
+   * @c The character to look for.
+   * @pos Where to start looking.
+   *
+   * @return Position of the first occurrence of `c` at or after `pos`, or npos.
+   */
+  std::size_t find(char c, std::size_t pos = 0) const {
+    if (pos >= length) {
+      return npos;
+    }
+    const void *p = std::memchr(start + pos, c, length - pos);
+    return p == nullptr ? npos : static_cast<const char *>(p) - start;
+  }
+
+  /* Drop characters from the front.
+   * @n How many characters to drop; clamped to the size of the view.
+   */
+  void removePrefix(std::size_t n) {
+    n = std::min(n, length);
+    start += n;
+    length -= n;
+  }
+
+  /* Drop characters from the back.
+   * @n How many characters to drop; clamped to the size of the view.
+   */
+  void removeSuffix(std::size_t n) { length -= std::min(n, length); }
+
+  /* Does the view start with the given string?
+   * @prefix What the view should start with.
+   *
+   * @return 'true' if the first characters are exactly `prefix`.
+   */
+  bool startsWith(const stringView &prefix) const {
+    return length >= prefix.length &&
+           std::equal(prefix.begin(), prefix.end(), start);
+  }
+
+  /* Copy into a string.
+   *
+   * @return A new std::string with the contents of the view.
+   */
+  operator std::string(void) const { return std::string(start, length); }
+
+ protected:
+  /* Start of the referenced data. */
+  const char *start;
+
+  /* Number of characters referenced. */
+  std::size_t length;
+};
+
+/* Compare views for equality.
+ * @a The first view to compare.
+ * @b The second view to compare.
+ *
+ * @return 'true' if both views contain exactly the same characters.
+ */
+static inline bool operator==(const stringView &a, const stringView &b) {
+  return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin());
+}
+
+/* Compare views for inequality.
+ * @a The first view to compare.
+ * @b The second view to compare.
+ *
+ * @return 'true' if the views differ in any way.
+ */
+static inline bool operator!=(const stringView &a, const stringView &b) {
+  return !(a == b);
+}
+
+/* Lexicographical view ordering.
+ * @a The first view to compare.
+ * @b The second view to compare.
+ *
+ * @return 'true' if `a` sorts before `b`, like it would for std::string.
+ */
+static inline bool operator<(const stringView &a, const stringView &b) {
+  return std::lexicographical_compare(
+      a.begin(), a.end(), b.begin(), b.end(),
+      [](char c1, char c2) -> bool {
+        return static_cast<unsigned char>(c1) < static_cast<unsigned char>(c2);
+      });
+}
+
+/* Write view to a stream.
+ * @out The stream to write to.
+ * @view The view to write.
+ *
+ * @return The stream that was passed in.
+ */
+static inline std::ostream &operator<<(std::ostream &out,
+                                       const stringView &view) {
+  return out.write(view.data(), view.size());
+}
+
+/* Case-fold an ASCII character.
+ * @c The character to fold.
+ *
+ * The case-insensitive parts of HTTP and MIME are all ASCII, so there's no
+ * need to involve a locale; anything that isn't an upper case ASCII letter is
+ * left alone.
+ *
+ * @return `c`, but in lower case if it is an upper case letter.
+ */
+static constexpr char foldCase(char c) {
+  return c >= 'A' && c <= 'Z' ? char(c | 0x20) : c;
+}
+
+/* Case-fold eight ASCII characters.
+ * @w Eight characters, packed into a word.
+ *
+ * Does the same as foldCase(), for all the bytes in a word at once. Each
+ * byte's high bit is set in `ge` if the low seven bits are at least 'A', and
+ * in `gt` if they're past 'Z', so the bytes that have it set in just one of the
+ * two, and did not have it set to begin with, are the upper case letters.
+ *
+ * @return `w`, with all upper case letters turned into lower case ones.
+ */
+static inline std::uint64_t foldCaseWord(std::uint64_t w) {
+  const std::uint64_t ones = 0x0101010101010101ull;
+  const std::uint64_t low = w & (0x7f * ones);
+  const std::uint64_t ge = low + (0x80 - 'A') * ones;
+  const std::uint64_t gt = low + (0x7f - 'Z') * ones;
+  const std::uint64_t upper = (ge ^ gt) & ~w & (0x80 * ones);
+  return w | (upper >> 2);
+}
+
 /* Case-insensitive comparison functor
  *
  * A simple functor used by the attribute map to compare strings without
- * caring for the letter case.
+ * caring for the letter case. Only ASCII letters are considered to have a case,
+ * which is what the "C" locale would say as well.
  */
 class caseInsensitiveLT
     : private std::binary_function<std::string, std::string, bool> {
@@ -37,8 +235,38 @@ class caseInsensitiveLT
    * @return 'true' if the first string is "less than" the second.
    */
   bool operator()(const std::string &a, const std::string &b) const {
-    return std::lexicographical_compare(a.begin(), a.end(), b.begin(), b.end(),
-                                        compare);
+    return (*this)(stringView(a), stringView(b));
+  }
+
+  /* Case-insensitive string comparison
+   * @a The first of the two strings to compare.
+   * @b The second of the two strings to compare.
+   *
+   * Compares eight characters at a time until it finds a difference, and then
+   * looks at the individual characters to find the first one that differs.
+   *
+   * @return 'true' if the first string is "less than" the second.
+   */
+  bool operator()(const stringView &a, const stringView &b) const {
+    const std::size_t n = std::min(a.size(), b.size());
+    std::size_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+      std::uint64_t wa, wb;
+      std::memcpy(&wa, a.data() + i, 8);
+      std::memcpy(&wb, b.data() + i, 8);
+      if (foldCaseWord(wa) != foldCaseWord(wb)) {
+        break;
+      }
+    }
+
+    for (; i < n; i++) {
+      if (foldCase(a[i]) != foldCase(b[i])) {
+        return compare(a[i], b[i]);
+      }
+    }
+
+    return a.size() < b.size();
   }
 
  protected:
@@ -46,12 +274,107 @@ class caseInsensitiveLT
    * @c1 The left-hand side of the comparison.
    * @c2 The right-hand side of the comparison.
    *
-   * Used by the operator() as the comparator for std::lexicographical_compare.
+   * Used by the operator() to compare the first characters that differ.
    *
    * @return true, if c1 comes before c2 after converting both to lower-case.
    */
   static bool compare(unsigned char c1, unsigned char c2) {
-    return std::tolower(c1) < std::tolower(c2);
+    return static_cast<unsigned char>(foldCase(char(c1))) <
+           static_cast<unsigned char>(foldCase(char(c2)));
+  }
+};
+
+/* Case-insensitive equality functor.
+ *
+ * Matches caseInsensitiveLT: two strings are equal if neither is less than the
+ * other. Use with caseInsensitiveHash for hash-based containers.
+ */
+class caseInsensitiveEQ {
+ public:
+  /* Case-insensitive string equality.
+   * @a The first of the two strings to compare.
+   * @b The second of the two strings to compare.
+   *
+   * @return 'true' if the two strings only differ in case.
+   */
+  bool operator()(const stringView &a, const stringView &b) const {
+    if (a.size() != b.size()) {
+      return false;
+    }
+
+    std::size_t i = 0;
+    for (; i + 8 <= a.size(); i += 8) {
+      std::uint64_t wa, wb;
+      std::memcpy(&wa, a.data() + i, 8);
+      std::memcpy(&wb, b.data() + i, 8);
+      if (foldCaseWord(wa) != foldCaseWord(wb)) {
+        return false;
+      }
+    }
+
+    for (; i < a.size(); i++) {
+      if (foldCase(a[i]) != foldCase(b[i])) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  /* Case-insensitive string equality.
+   * @a The first of the two strings to compare.
+   * @b The second of the two strings to compare.
+   *
+   * @return 'true' if the two strings only differ in case.
+   */
+  bool operator()(const std::string &a, const std::string &b) const {
+    return (*this)(stringView(a), stringView(b));
+  }
+};
+
+/* Case-insensitive hash functor.
+ *
+ * A case-folded FNV-1a hash, so strings that caseInsensitiveEQ considers equal
+ * have the same hash.
+ */
+class caseInsensitiveHash {
+ public:
+  /* Hash a string at compile time.
+   * @s The string to hash.
+   * @h The hash so far.
+   *
+   * Produces the same hash as operator(), but can be used in constant
+   * expressions.
+   *
+   * @return The hash of `s`.
+   */
+  static constexpr std::uint32_t hash(const char *s,
+                                      std::uint32_t h = 2166136261u) {
+    return *s == 0 ? h : hash(s + 1, (h ^ static_cast<unsigned char>(
+                                               foldCase(*s))) *
+                                         16777619u);
+  }
+
+  /* Hash a string.
+   * @s The string to hash.
+   *
+   * @return The hash of `s`.
+   */
+  std::size_t operator()(const stringView &s) const {
+    std::uint32_t h = 2166136261u;
+    for (const auto &c : s) {
+      h = (h ^ static_cast<unsigned char>(foldCase(c))) * 16777619u;
+    }
+    return h;
+  }
+
+  /* Hash a string.
+   * @s The string to hash.
+   *
+   * @return The hash of `s`.
+   */
+  std::size_t operator()(const std::string &s) const {
+    return (*this)(stringView(s));
   }
 };
 }
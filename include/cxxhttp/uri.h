@@ -14,47 +14,14 @@
 #if !defined(CXXHTTP_URI_H)
 #define CXXHTTP_URI_H
 
-#include <regex>
+#include <array>
 #include <string>
+#include <utility>
+#include <vector>
 
-namespace cxxhttp {
-/* URI components.
- *
- * All the portions making up a URI.
- */
-struct uriComponents {
-  /* The URI's scheme.
-   *
-   * The scheme of a URI.
-   */
-  std::string scheme;
-
-  /* The URI's authority.
-   *
-   * A URI's authority, like the host name in HTTP.
-   */
-  std::string authority;
-
-  /* The URI's path.
-   *
-   * Everything past the host name, and before the query portion.
-   */
-  std::string path;
-
-  /* The URI's query string.
-   *
-   * Everything after the initial '?', which is not part of the location portion
-   * of a URI.
-   */
-  std::string query;
-
-  /* A fragment identifier in a URI.
-   *
-   * Not actually used in the HTTP protocol, but might as well have it.
-   */
-  std::string fragment;
-};
+#include <cxxhttp/string.h>
 
+namespace cxxhttp {
 /* URI parser.
  *
  * Can take a URI and turn it into the relevant subcomponents, parsing and
@@ -71,26 +38,90 @@ class uri {
   /* Parse a given URI.
    * @pURI What to parse.
    *
-   * Parse a URI by applying the regular expression in RFC 3986, appendix B.
+   * Splits a URI the same way as the regular expression in RFC 3986, appendix
+   * B, in a single pass:
+   *
+   *     ^(([^:/?#]+):)?(//([^/?#]*))?([^?#]*)(\?([^#]*))?(#(.*))?
+   *
+   * Only the positions of the components are kept; see get() for decoding.
+   * Percent-encoded octets are checked here already, so valid() is known
+   * without having to decode anything.
    */
-  uri(const std::string &pURI) {
-    static const std::regex rx(
-        "^(([^:/?#]+):)?(//([^/?#]*))?([^?#]*)(\\?([^#]*))?(#(.*))?");
-    std::smatch match;
+  uri(const std::string &pURI) : text(pURI) {
+    const std::size_t n = text.size();
+    std::size_t i = 0;
 
-    isValid = std::regex_match(pURI, match, rx);
+    // the scheme is everything up to the first ':', if that comes before any
+    // of the other delimiters, and isn't the first character.
+    while (i < n && text[i] != ':' && text[i] != '/' && text[i] != '?' &&
+           text[i] != '#') {
+      i++;
+    }
+    if (i > 0 && i < n && text[i] == ':') {
+      parts[scheme_] = {0, i};
+      i++;
+    } else {
+      i = 0;
+    }
 
-    if (isValid) {
-      original = {
-          match[2], match[4], match[5], match[7], match[9],
-      };
+    if (n - i >= 2 && text[i] == '/' && text[i + 1] == '/') {
+      i += 2;
+      i = span(authority_, i, "/?#");
     }
 
-    decoded = {
-        decode(original.scheme, isValid),   decode(original.authority, isValid),
-        decode(original.path, isValid),     decode(original.query, isValid),
-        decode(original.fragment, isValid),
-    };
+    i = span(path_, i, "?#");
+
+    if (i < n && text[i] == '?') {
+      i = span(query_, i + 1, "#");
+    }
+
+    if (i < n && text[i] == '#') {
+      i = span(fragment_, i + 1, "");
+
+      // the '.' in the regex doesn't match line terminators, so those can't
+      // appear in a fragment.
+      if (text.find_first_of("\r\n", parts[fragment_].pos) !=
+          std::string::npos) {
+        isValid = false;
+        parts = {};
+        return;
+      }
+    }
+
+    for (const auto &p : parts) {
+      isValid = isValid && validEscapes(stringView(text).substr(p.pos, p.size));
+    }
+  }
+
+  /* Copy constructor.
+   * @u The URI to copy.
+   *
+   * Copies everything but the query parameter index, which refers to the
+   * original and is built again when needed.
+   */
+  uri(const uri &u)
+      : isValid(u.isValid),
+        text(u.text),
+        parts(u.parts),
+        decoded(u.decoded),
+        isDecoded(u.isDecoded) {}
+
+  /* Copy assignment.
+   * @u The URI to copy.
+   *
+   * Like the copy constructor, this drops the query parameter index.
+   *
+   * @return This URI.
+   */
+  uri &operator=(const uri &u) {
+    isValid = u.isValid;
+    text = u.text;
+    parts = u.parts;
+    decoded = u.decoded;
+    isDecoded = u.isDecoded;
+    index.clear();
+    indexed = false;
+    return *this;
   }
 
   /* Report whether the URI is currently valid.
@@ -107,7 +138,7 @@ class uri {
    *
    * @return The scheme, after being decoded.
    */
-  std::string scheme(void) const { return decoded.scheme; }
+  std::string scheme(void) const { return get(scheme_); }
 
   /* Get authority.
    *
@@ -115,7 +146,7 @@ class uri {
    *
    * @return The authority, after being decoded.
    */
-  std::string authority(void) const { return decoded.authority; }
+  std::string authority(void) const { return get(authority_); }
 
   /* Get path.
    *
@@ -123,7 +154,7 @@ class uri {
    *
    * @return The path, after being decoded.
    */
-  std::string path(void) const { return decoded.path; }
+  std::string path(void) const { return get(path_); }
 
   /* Get query string.
    *
@@ -131,7 +162,7 @@ class uri {
    *
    * @return The query string, after being decoded.
    */
-  std::string query(void) const { return decoded.query; }
+  std::string query(void) const { return get(query_); }
 
   /* Get fragment.
    *
@@ -139,7 +170,69 @@ class uri {
    *
    * @return The fragment, after being decoded.
    */
-  std::string fragment(void) const { return decoded.fragment; }
+  std::string fragment(void) const { return get(fragment_); }
+
+  /* Get scheme, without copying.
+   *
+   * @return The scheme, after being decoded. Valid until this URI changes.
+   */
+  stringView schemeView(void) const { return get(scheme_); }
+
+  /* Get authority, without copying.
+   *
+   * @return The authority, after being decoded. Valid until this URI changes.
+   */
+  stringView authorityView(void) const { return get(authority_); }
+
+  /* Get path, without copying.
+   *
+   * @return The path, after being decoded. Valid until this URI changes.
+   */
+  stringView pathView(void) const { return get(path_); }
+
+  /* Get query string, without copying.
+   *
+   * @return The query string, after being decoded. Valid until this URI
+   *     changes.
+   */
+  stringView queryView(void) const { return get(query_); }
+
+  /* Get fragment, without copying.
+   *
+   * @return The fragment, after being decoded. Valid until this URI changes.
+   */
+  stringView fragmentView(void) const { return get(fragment_); }
+
+  /* Get query parameters.
+   *
+   * Splits the query into `name=value` pairs at the ampersands, the first time
+   * this is called. Names and values are still percent-encoded, as they would
+   * not be told apart from the ampersands and equals signs that separate them
+   * otherwise; use decode() on them as needed. Parameters without an equals
+   * sign have an empty value, and empty parameters are skipped.
+   *
+   * @return The parameters, in the order in which they appear in the query.
+   *     The views refer to this URI and are valid until it changes.
+   */
+  const std::vector<std::pair<stringView, stringView>> &parameters(
+      void) const {
+    if (!indexed) {
+      stringView q = raw(query_);
+      while (!q.empty()) {
+        const std::size_t amp = q.find('&');
+        const stringView p = q.substr(0, amp);
+        q.removePrefix(amp == stringView::npos ? q.size() : amp + 1);
+
+        if (!p.empty()) {
+          const std::size_t eq = p.find('=');
+          const std::size_t value = eq == stringView::npos ? p.size() : eq + 1;
+          index.push_back({p.substr(0, eq), p.substr(value)});
+        }
+      }
+      indexed = true;
+    }
+    return index;
+  }
 
   /* Decode a URI component.
    * @s The URI component to process.
@@ -149,7 +242,7 @@ class uri {
    *
    * @return The decoded version of the component.
    */
-  static std::string decode(const std::string &s, bool &isValid) {
+  static std::string decode(const stringView &s, bool &isValid) {
     std::string rv;
 
     bool isEncoded = false;
@@ -192,13 +285,12 @@ class uri {
    * @return A URI, after being reconstructed from the individual parts.
    */
   operator std::string(void) const {
-    return (original.scheme.empty() ? original.scheme : original.scheme + ":") +
-           (original.authority.empty() ? original.authority
-                                       : "//" + original.authority) +
-           original.path +
-           (original.query.empty() ? original.query : "?" + original.query) +
-           (original.fragment.empty() ? original.fragment
-                                      : "#" + original.fragment);
+    const std::string scheme = raw(scheme_), authority = raw(authority_),
+                      query = raw(query_), fragment = raw(fragment_);
+    return (scheme.empty() ? scheme : scheme + ":") +
+           (authority.empty() ? authority : "//" + authority) +
+           std::string(raw(path_)) + (query.empty() ? query : "?" + query) +
+           (fragment.empty() ? fragment : "#" + fragment);
   }
 
  protected:
@@ -209,17 +301,118 @@ class uri {
    */
   bool isValid = true;
 
-  /* Original URI components.
+  /* URI components.
+   *
+   * Indices into <parts>, <decoded> and <isDecoded>. The trailing underscores
+   * keep these apart from the accessors of the same name.
+   */
+  enum component {
+    scheme_,
+    authority_,
+    path_,
+    query_,
+    fragment_,
+  };
+
+  /* Position of a URI component in <text>. */
+  struct position {
+    std::size_t pos, size;
+  };
+
+  /* The URI, as used in the constructor. */
+  std::string text;
+
+  /* Where the components are in <text>.
+   *
+   * Components that aren't there are empty.
+   */
+  std::array<position, 5> parts{};
+
+  /* Decoded components, for those that needed decoding.
+   *
+   * Only filled in on first access, and only for components with a '%'; see
+   * get().
+   */
+  mutable std::array<std::string, 5> decoded;
+
+  /* Whether the matching element of <decoded> has been filled in. */
+  mutable std::array<bool, 5> isDecoded{};
+
+  /* Query parameters, once they've been split up.
+   *
+   * Refers to <text>'s query; see parameters().
+   */
+  mutable std::vector<std::pair<stringView, stringView>> index;
+
+  /* Whether <index> has been built yet. */
+  mutable bool indexed = false;
+
+  /* Record the position of a component.
+   * @c The component.
+   * @start Where the component starts in <text>.
+   * @end Characters that end the component; it also ends with <text>.
+   *
+   * @return The position just past the component.
+   */
+  std::size_t span(component c, std::size_t start, const char *end) {
+    std::size_t i = text.find_first_of(end, start);
+    if (i == std::string::npos) {
+      i = text.size();
+    }
+    parts[c] = {start, i - start};
+    return i;
+  }
+
+  /* Get a component as it appears in the URI.
+   * @c The component.
    *
-   * Unmodified URI components, as used in the constructor.
+   * @return The component, still percent-encoded.
    */
-  uriComponents original;
+  stringView raw(component c) const {
+    return stringView(text).substr(parts[c].pos, parts[c].size);
+  }
+
+  /* Get a decoded component.
+   * @c The component.
+   *
+   * Components without a '%' don't change when decoded, so these are returned
+   * as they are. Everything else is decoded the first time it's needed.
+   *
+   * @return The decoded component.
+   */
+  stringView get(component c) const {
+    const stringView r = raw(c);
+    if (r.find('%') == stringView::npos) {
+      return r;
+    }
+    if (!isDecoded[c]) {
+      bool ok = true;
+      decoded[c] = decode(r, ok);
+      isDecoded[c] = true;
+    }
+    return decoded[c];
+  }
 
-  /* Decoded URI components.
+  /* Check percent-encoded octets.
+   * @s The URI component to check.
    *
-   * URI components, after decoding them.
+   * @return 'true' if every '%' in `s` is followed by two hex digits, which is
+   * when decode() would succeed.
    */
-  uriComponents decoded;
+  static bool validEscapes(const stringView &s) {
+    for (std::size_t i = s.find('%'); i != stringView::npos;
+         i = s.find('%', i + 3)) {
+      bool ok = i + 2 < s.size();
+      if (ok) {
+        decode(s[i + 1], ok);
+        decode(s[i + 2], ok);
+      }
+      if (!ok) {
+        return false;
+      }
+    }
+    return true;
+  }
 
   /* Decode hex digit.
    * @c The character to decode.
@@ -0,0 +1,189 @@
+/* Worker thread pool.
+ *
+ * Some handlers have a lot of work to do, e.g. rendering templates or
+ * compressing things, and while they're at it the I/O thread they were called
+ * on can't do anything else. A pool of worker threads lets those handlers run
+ * off to the side, while the I/O threads get on with other connections.
+ *
+ * See also:
+ * * Project Documentation: https://ef.gy/documentation/cxxhttp
+ * * Project Source Code: https://github.com/ef-gy/cxxhttp
+ * * Licence Terms: https://github.com/ef-gy/cxxhttp/blob/master/COPYING
+ *
+ * @copyright
+ * This file is part of the cxxhttp project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ */
+#if !defined(CXXHTTP_WORKERS_H)
+#define CXXHTTP_WORKERS_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <ef.gy/cli.h>
+#include <ef.gy/global.h>
+
+namespace cxxhttp {
+/* Bounded pool of worker threads.
+ *
+ * Jobs are queued with submit() and run on the next worker thread that is
+ * free. The threads are only started when the first job comes in, so <threads>
+ * can still be changed until then.
+ *
+ * Jobs can't be waited for; if there's a result, the job needs to hand it back
+ * itself, e.g. by posting it to an I/O service.
+ */
+class workers {
+ public:
+  /* Number of worker threads.
+   *
+   * With 0 threads, jobs are run by submit() right away, on the calling thread.
+   * That is also the default if ASIO was built without thread support, as the
+   * jobs would otherwise be posting back to an I/O service that doesn't expect
+   * that from another thread.
+   */
+#if defined(ASIO_DISABLE_THREADS)
+  std::size_t threads = 0;
+#else
+  std::size_t threads = 4;
+#endif
+
+  /* Maximum number of queued jobs.
+   *
+   * Jobs that have been submitted, but that no worker has started on yet. Once
+   * there's this many, submit() turns down any more.
+   */
+  std::size_t queueLimit = 64;
+
+  /* Stop all workers.
+   *
+   * Jobs that haven't been started yet are dropped, those that have are run to
+   * completion.
+   */
+  ~workers(void) {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      stopping = true;
+    }
+    ready.notify_all();
+
+    for (auto &t : pool) {
+      t.join();
+    }
+  }
+
+  /* Queue a job.
+   * @job The function to run on a worker thread.
+   *
+   * Starts the worker threads, if they haven't been, yet.
+   *
+   * @return 'true' if the job was queued, or run, and 'false' if the queue is
+   * full.
+   */
+  bool submit(std::function<void(void)> job) {
+    if (threads == 0) {
+      job();
+      return true;
+    }
+
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      if (queue.size() >= queueLimit) {
+        return false;
+      }
+      queue.push_back(std::move(job));
+
+      while (pool.size() < threads) {
+        pool.emplace_back([this] { work(); });
+      }
+    }
+    ready.notify_one();
+
+    return true;
+  }
+
+  /* Number of queued jobs.
+   *
+   * @return How many jobs are waiting for a worker thread.
+   */
+  std::size_t queued(void) const {
+    std::lock_guard<std::mutex> guard(lock);
+    return queue.size();
+  }
+
+ protected:
+  /* Guards <queue>, <pool> and <stopping>. */
+  mutable std::mutex lock;
+
+  /* Signalled when there's a new job, or when it's time to stop. */
+  std::condition_variable ready;
+
+  /* Jobs that no worker has started on yet. */
+  std::deque<std::function<void(void)>> queue;
+
+  /* The worker threads. */
+  std::vector<std::thread> pool;
+
+  /* Set by the destructor to make the workers stop. */
+  bool stopping = false;
+
+  /* Run jobs until told to stop.
+   *
+   * This is what each worker thread does.
+   */
+  void work(void) {
+    std::unique_lock<std::mutex> guard(lock);
+
+    while (true) {
+      ready.wait(guard, [this] { return stopping || !queue.empty(); });
+      if (stopping) {
+        return;
+      }
+
+      auto job = std::move(queue.front());
+      queue.pop_front();
+
+      guard.unlock();
+      job();
+      guard.lock();
+    }
+  }
+};
+
+#if !defined(ASIO_DISABLE_THREADS)
+/* Worker thread count CLI option.
+ *
+ * The format is `workers:(count)`, or `--workers=(count)`. Sets the number of
+ * threads that handlers of blocking servlets are run on. Use 0 to run them on
+ * the I/O threads instead.
+ */
+static efgy::cli::option workersOption(
+    "-{0,2}workers[:=]([0-9]+)",
+    [](std::smatch &m) -> bool {
+      efgy::global<workers>().threads = std::stoul(m[1]);
+      return true;
+    },
+    "run blocking handlers on this many[1] worker threads; defaults to 4");
+
+/* Worker queue limit CLI option.
+ *
+ * The format is `worker-queue:(count)`, or `--worker-queue=(count)`. Requests
+ * for blocking servlets are answered with a 503 while this many of them are
+ * already waiting for a worker thread.
+ */
+static efgy::cli::option workerQueueOption(
+    "-{0,2}worker-queue[:=]([0-9]+)",
+    [](std::smatch &m) -> bool {
+      efgy::global<workers>().queueLimit = std::stoul(m[1]);
+      return true;
+    },
+    "queue up to this many[1] blocking handlers; defaults to 64");
+#endif
+}
+
+#endif
@@ -11,6 +11,9 @@
  * while the programme is running, open a browser and go to
  * http://localhost:8080/ and you should see the familiar greeting.
  *
+ * To handle requests on several threads, add e.g. `--threads=4`, or to run
+ * several independent shards, put e.g. `--shards=4` before the `http:` option.
+ *
  * Contains a very basic HTTP client, primarily to test the library against an
  * HTTP server running on a UNIX socket.
  *
@@ -24,7 +27,6 @@
  * under the terms of an MIT/X11-style licence, described in the COPYING file.
  */
 
-#define ASIO_DISABLE_THREADS
 #define USE_DEFAULT_IO_MAIN
 #include <cxxhttp/httpd.h>
 
@@ -0,0 +1,180 @@
+/* Test cases for the combined regex automaton.
+ *
+ * The automaton is supposed to agree with std::regex_match() on all the regexen
+ * it accepts, so most of these tests compare the two.
+ *
+ * See also:
+ * * Project Documentation: https://ef.gy/documentation/cxxhttp
+ * * Project Source Code: https://github.com/ef-gy/cxxhttp
+ * * Licence Terms: https://github.com/ef-gy/cxxhttp/blob/master/COPYING
+ *
+ * @copyright
+ * This file is part of the cxxhttp project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ */
+
+#include <ef.gy/test-case.h>
+
+#include <cxxhttp/automaton.h>
+
+#include <regex>
+
+using namespace cxxhttp;
+
+/* Test which regexen are supported.
+ * @log Test output stream.
+ *
+ * Adds some regexen and checks whether the automaton takes them.
+ *
+ * @return 'true' on success, 'false' otherwise.
+ */
+bool testSupported(std::ostream &log) {
+  struct sampleData {
+    std::string regex;
+    bool supported;
+  };
+
+  std::vector<sampleData> tests{
+      {"", true},
+      {"/", true},
+      {"/.*", true},
+      {"^\\*|/.*", true},
+      {"/api/v[12]/([0-9]+)", true},
+      {"/(?:a|b)+/c{2,3}d{2,}e{0,1}", true},
+      {"/a*?b+?", true},
+      {"[-a-z_\\d.]*", true},
+      {"[\\]\\\\]", true},
+      {"(a)\\1", false},
+      {"(?=a)a", false},
+      {"(?!a)b", false},
+      {"\\ba", false},
+      {"[[:alpha:]]", false},
+      {"[]", false},
+      {"[\\D]", false},
+      {"[z-a]", false},
+      {"^*", false},
+      {"a{0}", false},
+      {"a{99999}", false},
+      {"(a", false},
+      {"a)", false},
+  };
+
+  for (const auto &tt : tests) {
+    automaton a;
+    const bool v = a.add(tt.regex, 0);
+    if (v != tt.supported) {
+      log << "add('" << tt.regex << "')=" << v << ", expected " << tt.supported
+          << "\n";
+      return false;
+    }
+    if (!v && !a.match(tt.regex).empty()) {
+      log << "unsupported regex '" << tt.regex << "' left something behind\n";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/* Test matching.
+ * @log Test output stream.
+ *
+ * Compiles a bunch of regexen into one automaton, then matches a number of
+ * strings against it and checks that it finds exactly the regexen that
+ * std::regex_match() finds. This is done with the default limit on states, and
+ * with a limit so low that the states keep getting thrown away.
+ *
+ * @return 'true' on success, 'false' otherwise.
+ */
+bool testMatch(std::ostream &log) {
+  const std::vector<std::string> regexen{
+      "",
+      "/",
+      "/.*",
+      "^\\*|/.*",
+      ".*",
+      "^/$",
+      "/robots\\.txt",
+      "/api/(.*)",
+      "/api/v[12]/user/([0-9]+)",
+      "/api/v\\d/user/(\\w+)",
+      "/a\\?b=c",
+      "/ab?",
+      "/(x|y)+/z",
+      "/a{2,3}",
+      "/b{2,}",
+      "/c{2}",
+      "/[^/]*/?",
+      "/\\s\\S",
+      "a$|b^|c",
+      "(^a|b)c",
+      "/x(?:yz)*?",
+      "[-a-c]+",
+  };
+
+  const std::vector<std::string> texts{
+      "",          "/",           "*",           "/robots.txt",
+      "/robotsxtxt", "/api/",     "/api/v1/user/12", "/api/v3/user/ab_c",
+      "/api/v2/user/", "/a?b=c",  "/a",          "/ab",
+      "/abb",      "/x/z",        "/xyxy/z",     "/aa",
+      "/aaa",      "/aaaa",       "/bb",         "/bbbbbb",
+      "/cc",       "/ccc",        "/foo/",       "/foo/bar",
+      "/ \t",      "/  ",         "a",           "b",
+      "c",         "ac",          "bc",          "/x",
+      "/xyzyz",    "/xyzy",       "-ab-",        "/\n",
+      "/\xc3\xa4",
+  };
+
+  for (const std::size_t maxStates : {1024, 2}) {
+    automaton a;
+    a.maxStates = maxStates;
+    std::vector<std::regex> rx;
+
+    for (std::size_t i = 0; i < regexen.size(); i++) {
+      if (!a.add(regexen[i], i)) {
+        log << "regex '" << regexen[i] << "' should have been supported\n";
+        return false;
+      }
+      rx.push_back(std::regex(regexen[i]));
+    }
+
+    for (const auto &text : texts) {
+      std::vector<std::size_t> expected;
+      for (std::size_t i = 0; i < rx.size(); i++) {
+        if (std::regex_match(text, rx[i])) {
+          expected.push_back(i);
+        }
+      }
+
+      const auto v = a.match(text);
+      if (v != expected) {
+        log << "'" << text << "' matched " << v.size() << " regexen, expected "
+            << expected.size() << ":";
+        for (const auto &i : expected) {
+          log << " '" << regexen[i] << "'";
+        }
+        log << "\n";
+        return false;
+      }
+
+      for (std::size_t prefix = 0; prefix <= text.size(); prefix++) {
+        std::vector<std::size_t> atPrefix, atEnd;
+        a.match(text, prefix, atPrefix, atEnd);
+        if (atEnd != expected || atPrefix != a.match(text.substr(0, prefix))) {
+          log << "'" << text << "' with prefix " << prefix
+              << " did not match the same as the separate strings\n";
+          return false;
+        }
+      }
+    }
+  }
+
+  return true;
+}
+
+namespace test {
+using efgy::test::function;
+
+static function supported(testSupported);
+static function match(testMatch);
+}
@@ -0,0 +1,147 @@
+/* Test cases for deferred replies.
+ *
+ * Handlers defer their reply with a token, which then needs to send exactly one
+ * reply, whether it's from the handler or due to a timeout or an abandoned
+ * token.
+ *
+ * See also:
+ * * Project Documentation: https://ef.gy/documentation/cxxhttp
+ * * Project Source Code: https://github.com/ef-gy/cxxhttp
+ * * Licence Terms: https://github.com/ef-gy/cxxhttp/blob/master/COPYING
+ *
+ * @copyright
+ * This file is part of the cxxhttp project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ */
+
+#define ASIO_DISABLE_THREADS
+#include <ef.gy/test-case.h>
+
+#include <thread>
+
+#include <cxxhttp/http-processor.h>
+
+using namespace cxxhttp;
+
+/* Test deferred replies.
+ * @log Test output stream.
+ *
+ * Runs a few handlers that defer their replies through the server processor,
+ * and resumes the requests on the test's own thread, like the flow would on
+ * the session's strand.
+ *
+ * @return 'true' on success, 'false' otherwise.
+ */
+bool testDeferred(std::ostream &log) {
+  struct sampleData {
+    std::string request;
+    bool deferred;
+    std::string status;
+  };
+
+  std::vector<sampleData> tests{
+      {"GET /later HTTP/1.1", true, "HTTP/1.1 200 OK"},
+      {"GET /twice HTTP/1.1", true, "HTTP/1.1 202 Accepted"},
+      {"GET /dropped HTTP/1.1", true, "HTTP/1.1 500 Internal Server Error"},
+      {"GET /expired HTTP/1.1", true, "HTTP/1.1 504 Gateway Timeout"},
+  };
+
+  http::processor::server proc;
+  std::vector<http::deferred> kept;
+
+  http::servlet later("/later", [](http::sessionData &sess, std::smatch &) {
+    http::deferred reply(sess);
+    std::thread([reply] { reply.reply(200, "later"); }).join();
+  }, "GET", {}, "", proc.servlets);
+
+  bool second = true;
+  http::servlet twice("/twice", [&](http::sessionData &sess, std::smatch &) {
+    http::deferred reply(sess);
+    reply.reply(202, "first");
+    second = reply.reply(200, "second");
+  }, "GET", {}, "", proc.servlets);
+
+  http::servlet dropped("/dropped", [](http::sessionData &sess,
+                                       std::smatch &) {
+    http::deferred reply(sess);
+  }, "GET", {}, "", proc.servlets);
+
+  http::servlet expired("/expired", [&](http::sessionData &sess,
+                                        std::smatch &) {
+    kept.emplace_back(sess);
+  }, "GET", {}, "", proc.servlets);
+
+  for (const auto &tt : tests) {
+    std::vector<std::function<void(void)>> resumed;
+
+    http::sessionData sess;
+    sess.inboundRequest = tt.request;
+    sess.resume = [&resumed](std::function<void(void)> then) {
+      resumed.push_back(then);
+    };
+
+    sess.status = http::stProcessing;
+    proc.handle(sess);
+
+    if ((sess.status == http::stDeferred) != tt.deferred) {
+      log << "request '" << tt.request << "' deferred: " << !tt.deferred
+          << ", expected " << tt.deferred << "\n";
+      return false;
+    }
+
+    if (sess.status == http::stDeferred && resumed.empty() && sess.expire) {
+      // this is what the flow does once the timeout runs out.
+      sess.expire();
+    }
+
+    if (resumed.size() != 1) {
+      log << "request '" << tt.request << "' was resumed " << resumed.size()
+          << " times, expected once\n";
+      return false;
+    }
+
+    sess.status = http::stProcessing;
+    resumed.front()();
+
+    if (sess.outboundQueue.size() != 1) {
+      log << "expected exactly one reply to '" << tt.request << "', got "
+          << sess.outboundQueue.size() << "\n";
+      return false;
+    }
+
+    const std::string v = sess.outboundQueue.front();
+    if (v.compare(0, tt.status.size(), tt.status) != 0) {
+      log << "unexpected reply to '" << tt.request << "':\n" << v << "\n";
+      return false;
+    }
+  }
+
+  if (second) {
+    log << "second reply with the same token should have been turned down\n";
+    return false;
+  }
+
+  if (kept.size() != 1 || kept.front().reply(200, "too late")) {
+    log << "reply after the timeout should have been turned down\n";
+    return false;
+  }
+
+  // without a flow to resume the request, replies can't be deferred.
+  http::sessionData sess;
+  sess.status = http::stProcessing;
+  http::deferred reply(sess);
+
+  if (reply.valid() || reply.reply(200, "nowhere") ||
+      sess.status != http::stProcessing) {
+    log << "should not be able to defer a reply without a flow\n";
+    return false;
+  }
+
+  return true;
+}
+
+namespace test {
+using efgy::test::function;
+
+static function deferred(testDeferred);
+}
@@ -102,6 +102,18 @@ bool testUNIX(std::ostream &log) {
        "An error occurred while processing your request. "
        "That's all I know.\n",
       },
+      {
+       "GET", "/deferred", {}, 200, "Hello Later!",
+      },
+      {
+       "GET",
+       "/timeout",
+       {},
+       504,
+       "# Gateway Timeout\n\n"
+       "An error occurred while processing your request. "
+       "That's all I know.\n",
+      },
   };
 
   http::servlet foo("/foo", [](http::sessionData &sess, std::smatch &) {
@@ -113,6 +125,19 @@ bool testUNIX(std::ostream &log) {
                             },
                     "GET|FOO", {{"Accept", "text/foo"}});
 
+  http::servlet later("/deferred", [](http::sessionData &sess, std::smatch &) {
+    http::deferred reply(sess);
+    efgy::global<cxxhttp::service>().post(
+        [reply] { reply.reply(200, "Hello Later!"); });
+  });
+
+  std::vector<http::deferred> forgotten;
+  http::servlet never("/timeout",
+                      [&forgotten](http::sessionData &sess, std::smatch &) {
+                        forgotten.emplace_back(sess,
+                                               std::chrono::milliseconds(10));
+                      });
+
   efgy::cli::options opts({"http:unix:/tmp/cxxhttp-test.socket"});
 
   net::endpoint<transport::unix> lookup(name);
@@ -95,7 +95,7 @@ bool testErrorHandler(std::ostream &log) {
       return false;
     }
 
-    const auto &m = sess.outboundQueue.front();
+    const std::string m = sess.outboundQueue.front();
     if (m != tt.message) {
       log << "error() produced an unexpected message: '" << m << "' expected: '"
           << tt.message << "'\n";
@@ -0,0 +1,72 @@
+/* Test cases for the HTTP flow control helpers.
+ *
+ * The flow control itself needs a connection to do anything, so this only
+ * tests the pieces that can be used on their own.
+ *
+ * See also:
+ * * Project Documentation: https://ef.gy/documentation/cxxhttp
+ * * Project Source Code: https://github.com/ef-gy/cxxhttp
+ * * Licence Terms: https://github.com/ef-gy/cxxhttp/blob/master/COPYING
+ *
+ * @copyright
+ * This file is part of the cxxhttp project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ */
+
+#define ASIO_DISABLE_THREADS
+#include <ef.gy/test-case.h>
+
+#include <cxxhttp/http-flow.h>
+
+using namespace cxxhttp;
+
+/* Test header block match condition.
+ * @log Test output stream.
+ *
+ * Fills an input buffer with some data and checks if the end of the header
+ * block is found where it should be.
+ *
+ * @return 'true' on success, 'false' otherwise.
+ */
+bool testEndOfHeader(std::ostream &log) {
+  struct sampleData {
+    std::string in;
+    std::size_t limit;
+    bool match;
+    std::size_t end;
+  };
+
+  std::vector<sampleData> tests{
+      {"", 100, false, 0},
+      {"GET / HTTP/1.1\r\n", 100, false, 14},
+      {"GET / HTTP/1.1\r\n\r\n", 100, true, 18},
+      {"GET / HTTP/1.1\n\n", 100, true, 16},
+      {"GET / HTTP/1.1\r\nA: b\r\n\r\nbody", 100, true, 24},
+      {"GET / HTTP/1.1\r\nA: b\r\n\r", 100, false, 21},
+      {"GET / HTTP/1.1\r\nA: b\r\n", 10, true, 22},
+  };
+
+  for (const auto &tt : tests) {
+    asio::streambuf input;
+    std::ostream(&input) << tt.in;
+
+    const http::endOfHeader eoh{&input, tt.limit};
+    const auto begin = asio::buffers_begin(input.data());
+    const auto r = eoh(begin, asio::buffers_end(input.data()));
+    const std::size_t end = r.first - begin;
+
+    if (r.second != tt.match || end != tt.end) {
+      log << "endOfHeader('" << tt.in << "')=(" << end << ", " << r.second
+          << "), expected (" << tt.end << ", " << tt.match << ")\n";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+namespace test {
+using efgy::test::function;
+
+static function endOfHeader(testEndOfHeader);
+}
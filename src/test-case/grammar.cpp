@@ -91,8 +91,116 @@ bool testGrammar(std::ostream &log) {
   return true;
 }
 
+/* Test character class table.
+ * @log Test output stream.
+ *
+ * The character class table must agree with the regular expressions for the
+ * same classes, for every possible character.
+ *
+ * @return 'true' on success, 'false' otherwise.
+ */
+bool testCharacterClasses(std::ostream &log) {
+  struct sampleData {
+    std::string regex;
+    unsigned short flag;
+  };
+
+  std::vector<sampleData> tests{
+      {http::grammar::alpha, http::grammar::ccAlpha},
+      {http::grammar::digit, http::grammar::ccDigit},
+      {http::grammar::vchar, http::grammar::ccVchar},
+      {http::grammar::wsp, http::grammar::ccWhitespace},
+      {http::grammar::obsText, http::grammar::ccObsText},
+      {http::grammar::tchar, http::grammar::ccTchar},
+      {http::grammar::qdtext, http::grammar::ccQdtext},
+      {http::grammar::ctext, http::grammar::ccCtext},
+      {http::grammar::fieldVchar, http::grammar::ccFieldVchar},
+      {http::grammar::fieldVcharWS, http::grammar::ccFieldVcharWS},
+  };
+
+  for (const auto &tt : tests) {
+    const std::regex rx(tt.regex);
+    for (unsigned c = 0; c < 256; c++) {
+      const std::string in(1, char(c));
+      const bool v = http::grammar::is(c, tt.flag);
+      if (v != std::regex_match(in, rx)) {
+        log << "is(" << c << ", " << tt.flag << ")='" << v
+            << "', but the regex '" << tt.regex << "' disagrees\n";
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+/* Test validators.
+ * @log Test output stream.
+ *
+ * The validators are shortcuts for matching whole strings against some of the
+ * grammar rules, so they're tested against those very same rules.
+ *
+ * @return 'true' on success, 'false' otherwise.
+ */
+bool testValidators(std::ostream &log) {
+  struct sampleData {
+    std::string regex;
+    bool (*valid)(const stringView &);
+  };
+
+  std::vector<sampleData> tests{
+      {http::grammar::token, http::grammar::validToken},
+      {http::grammar::fieldContent, http::grammar::validFieldContent},
+      {http::grammar::reasonPhrase, http::grammar::validReasonPhrase},
+      {http::grammar::quotedString, http::grammar::validQuotedString},
+  };
+
+  const std::vector<std::string> samples{
+      "",
+      "a",
+      "foo",
+      "foo-B4r",
+      "foo-B4r ",
+      " ",
+      "fo  of",
+      " foof ",
+      "foo\tbar",
+      "foo\rbar",
+      "foo\nbar",
+      "foo\x7f",
+      "foo\x80\xff",
+      "foo: bar",
+      "\"\"",
+      "\"foo\"",
+      "\"foo\"\"",
+      "\"foo\"bar\"",
+      "\"foo=\\\"bar\\\"\"",
+      "\"foo\\\"",
+      "\"foo\\\x01\"",
+      "\"",
+      "This reason phrase is long enough to need a vector or two.",
+      "This reason phrase is long enough to need a vector or two\x01",
+  };
+
+  for (const auto &tt : tests) {
+    const std::regex rx(tt.regex);
+    for (const auto &in : samples) {
+      const bool v = tt.valid(in);
+      if (v != std::regex_match(in, rx)) {
+        log << "validating '" << in << "' returned '" << v
+            << "', but the regex '" << tt.regex << "' disagrees\n";
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
 namespace test {
 using efgy::test::function;
 
 static function grammar(testGrammar);
+static function characterClasses(testCharacterClasses);
+static function validators(testValidators);
 }
@@ -124,6 +124,10 @@ bool testAbsorb(std::ostream &log) {
        true,
        false},
       {{}, "bad line", "", "", "", false, false},
+      {{}, "a:  b \t\r\n", "", "a: b\r\n", "a", true, false},
+      {{}, " b", "", "", "", false, false},
+      {{}, "a b: c", "", "", "", false, false},
+      {{}, "a: b\x01", "", "", "", false, false},
       {{{"a", "b"}}, "", "a", "a: b\r\n", "a", true, true},
   };
 
@@ -219,6 +223,92 @@ bool testMerge(std::ostream &log) {
   return true;
 }
 
+/* Test header lookups.
+ * @log Test output stream.
+ *
+ * Well-known headers are looked up through their slots, everything else by
+ * name. Either way, lookups need to ignore case and keep working as other
+ * headers are added and removed around them.
+ *
+ * @return 'true' on success, 'false' otherwise.
+ */
+bool testLookup(std::ostream &log) {
+  struct sampleData {
+    headers in;
+    std::string erase, name;
+    headerField id;
+    bool found;
+    std::string value, order;
+    std::size_t size;
+  };
+
+  std::vector<sampleData> tests{
+      {{}, "", "Host", hfHost, false, "", "", 1},
+      {{{"Host", "a"}}, "", "host", hfHost, true, "a", "Host", 1},
+      {{{"HOST", "a"}, {"Accept", "b"}}, "", "Host", hfHost, true, "a",
+       "Accept,HOST", 2},
+      {{{"x-foo", "a"}, {"Accept", "b"}}, "", "X-Foo", hfUnknown, true, "a",
+       "Accept,x-foo", 2},
+      {{{"Vary", "a"}, {"b", "c"}, {"Allow", "d"}}, "b", "vary", hfVary, true,
+       "a", "Allow,Vary", 2},
+      {{{"Vary", "a"}, {"b", "c"}, {"Allow", "d"}}, "allow", "Vary", hfVary,
+       true, "a", "b,Vary", 2},
+      {{{"Vary", "a"}, {"Allow", "d"}}, "VARY", "Vary", hfVary, false, "",
+       "Allow", 2},
+      {{{"Content-Type", "a"},
+        {"Content-Length", "1"},
+        {"Content-Lengthy", "b"}},
+       "", "content-length", hfContentLength, true, "1",
+       "Content-Length,Content-Lengthy,Content-Type", 3},
+  };
+
+  for (const auto &tt : tests) {
+    headers h = tt.in;
+    if (!tt.erase.empty() && h.erase(tt.erase) != 1) {
+      log << "could not erase '" << tt.erase << "'\n";
+      return false;
+    }
+
+    if (identify(tt.name) != tt.id) {
+      log << "identify('" << tt.name << "')=" << int(identify(tt.name))
+          << ", expected " << int(tt.id) << "\n";
+      return false;
+    }
+
+    const auto it = h.find(tt.name);
+    if ((it != h.end()) != tt.found || h.count(tt.name) != (tt.found ? 1 : 0) ||
+        (tt.found && it->second != tt.value)) {
+      log << "find('" << tt.name << "') did not find '" << tt.value << "'\n";
+      return false;
+    }
+
+    if (tt.id != hfUnknown && h.find(tt.id) != h.find(tt.name)) {
+      log << "find(" << int(tt.id) << ") and find('" << tt.name
+          << "') disagree\n";
+      return false;
+    }
+
+    std::string order;
+    for (const auto &f : h) {
+      order += (order.empty() ? "" : ",") + f.first;
+    }
+    if (order != tt.order) {
+      log << "headers are in the wrong order: '" << order << "', expected '"
+          << tt.order << "'\n";
+      return false;
+    }
+
+    h[tt.name] = "z";
+    if (h.find(tt.name) == h.end() || h.find(tt.name)->second != "z" ||
+        h.size() != tt.size) {
+      log << "could not set '" << tt.name << "'\n";
+      return false;
+    }
+  }
+
+  return true;
+}
+
 namespace test {
 using efgy::test::function;
 
@@ -226,4 +316,6 @@ static function toString(testToString);
 static function append(testAppend);
 static function absorb(testAbsorb);
 static function clear(testClear);
+static function merge(testMerge);
+static function lookup(testLookup);
 }
@@ -0,0 +1,97 @@
+/* Test cases for outbound HTTP messages.
+ *
+ * Messages are written with gather writes, possibly several at once, so these
+ * test that the right messages and buffers end up in a write.
+ *
+ * See also:
+ * * Project Documentation: https://ef.gy/documentation/cxxhttp
+ * * Project Source Code: https://github.com/ef-gy/cxxhttp
+ * * Licence Terms: https://github.com/ef-gy/cxxhttp/blob/master/COPYING
+ *
+ * @copyright
+ * This file is part of the cxxhttp project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ */
+
+#define ASIO_DISABLE_THREADS
+#include <ef.gy/test-case.h>
+
+#include <cxxhttp/http-message.h>
+
+using namespace cxxhttp;
+
+/* Test message gathering.
+ * @log Test output stream.
+ *
+ * Queues up some messages and gathers them with different limits, to see if
+ * the limits are respected and the buffers match the messages.
+ *
+ * @return 'true' on success, 'false' otherwise.
+ */
+bool testGather(std::ostream &log) {
+  struct sampleData {
+    std::string header;
+    std::vector<std::string> bodies;
+    std::size_t maxBytes, maxBuffers;
+    std::size_t count, buffers, left;
+  };
+
+  std::vector<sampleData> tests{
+      {"header\r\n", {}, 100, 64, 0, 0, 0},
+      {"header\r\n", {""}, 100, 64, 1, 1, 0},
+      {"header\r\n", {"foo"}, 100, 64, 1, 2, 0},
+      {"header\r\n", {"foo", "", "bar"}, 100, 64, 3, 5, 0},
+      {"header\r\n", {"foo", "", "bar"}, 100, 3, 2, 3, 1},
+      {"header\r\n", {"foo", "", "bar"}, 100, 1, 1, 2, 2},
+      {"header\r\n", {"foo", "", "bar"}, 19, 64, 2, 3, 1},
+      {"header\r\n", {"foo", "", "bar"}, 18, 64, 1, 2, 2},
+      {"header\r\n", {"foo", "", "bar"}, 1, 64, 1, 2, 2},
+      {"", {"foo", "", "bar"}, 100, 64, 3, 2, 0},
+  };
+
+  for (const auto &tt : tests) {
+    std::list<http::message> queue, batch;
+    std::vector<asio::const_buffer> buffers;
+    std::string expected;
+
+    for (const auto &b : tt.bodies) {
+      // each message is usually 8 bytes for the header, plus the body.
+      queue.push_back(http::message{
+          tt.header,
+          b.empty() ? nullptr : std::make_shared<const std::string>(b)});
+    }
+
+    const auto count =
+        http::gather(queue, batch, buffers, tt.maxBytes, tt.maxBuffers);
+
+    if (count != tt.count || batch.size() != tt.count ||
+        buffers.size() != tt.buffers || queue.size() != tt.left) {
+      log << "gather() took " << count << " messages in " << buffers.size()
+          << " buffers, leaving " << queue.size() << "; expected " << tt.count
+          << " messages in " << tt.buffers << " buffers, leaving " << tt.left
+          << "\n";
+      return false;
+    }
+
+    for (const auto &m : batch) {
+      expected += std::string(m);
+    }
+
+    std::string written(asio::buffer_size(buffers), 0);
+    asio::buffer_copy(asio::buffer(&written[0], written.size()), buffers);
+
+    if (written != expected) {
+      log << "gather() produced buffers with '" << written << "', expected '"
+          << expected << "'\n";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+namespace test {
+using efgy::test::function;
+
+static function gather(testGather);
+}
@@ -15,6 +15,8 @@
 
 #include <ef.gy/test-case.h>
 
+#include <thread>
+
 #include <cxxhttp/mime-type.h>
 
 using namespace cxxhttp;
@@ -127,6 +129,16 @@ bool testNormalise(std::ostream &log) {
     }
   }
 
+  // replacing a type must not leave anything of the old one behind.
+  mimeType m("text/plain");
+  const std::string before = m;
+  m = mimeType("image/png; a=b");
+  if (before != "text/plain" || std::string(m) != "image/png; a=b" ||
+      m == mimeType("text/plain") || !(m == mimeType("image/*; a=b"))) {
+    log << "replaced type came out as '" << std::string(m) << "'\n";
+    return false;
+  }
+
   return true;
 }
 
@@ -151,6 +163,12 @@ bool testCompare(std::ostream &log) {
       {"foo/bar", "foo/*", false, true, true, false, true},
       {"foo/bar; a=b", "foo/* ; a =b", false, true, true, false, true},
       {"foo/bar ;a= b", "foo/bar; a =c", true, false, false, false, false},
+      {"text/plain", "application/json", false, true, false, false, false},
+      {"Text/HTML", "text/html", false, false, true, false, false},
+      {"text/html", "text/x-foo", true, false, false, false, false},
+      {"text/plain", "text/*", false, true, true, false, true},
+      {"text/plain; a=b", "text/plain", false, true, false, false, false},
+      {"text/plain; a=b", "text/plain+xml", true, false, false, false, false},
   };
 
   for (const auto &tt : tests) {
@@ -182,10 +200,82 @@ bool testCompare(std::ostream &log) {
   return true;
 }
 
+/* Test changing MIME types after the parse.
+ * @log Test output stream.
+ *
+ * The type, subtype and attributes can be changed after a type has been parsed
+ * and converted to a string. Comparisons and later conversions need to go by
+ * what's there now, not by what the parse found or by what was converted.
+ *
+ * @return 'true' on success, 'false' otherwise.
+ */
+bool testChange(std::ostream &log) {
+  mimeType m("text/plain");
+  const std::string before = m;
+
+  m.subtype = "x-foo";
+  if (before != "text/plain" || std::string(m) != "text/x-foo" ||
+      m == mimeType("text/plain") || !(m == mimeType("text/x-foo")) ||
+      !(mimeType("text/plain") < m) || m < mimeType("text/plain")) {
+    log << "changed subtype came out as '" << std::string(m) << "'\n";
+    return false;
+  }
+
+  m.subtype = "html";
+  m.attributes["a"] = "b c";
+  if (std::string(m) != "text/html; a=\"b c\"" ||
+      !(m == mimeType("text/html; a=\"b c\"")) ||
+      m == mimeType("text/html") || !(m < mimeType("text/plain"))) {
+    log << "changed type came out as '" << std::string(m) << "'\n";
+    return false;
+  }
+
+  return true;
+}
+
+/* Test converting a shared MIME type on several threads.
+ * @log Test output stream.
+ *
+ * The normalised string is cached on the first conversion, which must be safe
+ * to do for a const instance that several threads use at the same time.
+ *
+ * @return 'true' on success, 'false' otherwise.
+ */
+bool testShared(std::ostream &log) {
+  const mimeType m("Text/HTML; charset=UTF-8; q=\"a b\"");
+  const std::string expected = "text/html; charset=UTF-8; q=\"a b\"";
+  std::vector<char> ok(4, true);
+  std::vector<std::thread> threads;
+
+  for (std::size_t t = 0; t < ok.size(); t++) {
+    threads.emplace_back([&m, &ok, &expected, t] {
+      for (std::size_t i = 0; i < 1000; i++) {
+        const mimeType copy = m;
+        ok[t] = ok[t] && std::string(m) == expected &&
+                std::string(copy) == expected;
+      }
+    });
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+
+  for (const auto &o : ok) {
+    if (!o) {
+      log << "shared type didn't convert to '" << expected << "'\n";
+      return false;
+    }
+  }
+
+  return true;
+}
+
 namespace test {
 using efgy::test::function;
 
 static function parser(testParser);
 static function normalise(testNormalise);
 static function compare(testCompare);
+static function change(testChange);
+static function shared(testShared);
 }
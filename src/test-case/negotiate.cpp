@@ -15,6 +15,8 @@
 
 #include <ef.gy/test-case.h>
 
+#include <thread>
+
 #include <cxxhttp/negotiate.h>
 
 using namespace cxxhttp;
@@ -87,6 +89,16 @@ bool testQvalue(std::ostream &log) {
       {"b;q=0.2", "b", "b;q=0.2", "b", {}, {}, 200},
       {"a;q=0.3", "a", "a;q=0.3", "a", {}, {}, 300},
       {"foo;q=0.5", "foo", "foo;q=0.5", "foo", {}, {}, 500},
+      {"foo;q=0.251", "foo", "foo;q=0.251", "foo", {}, {}, 251},
+      {"foo;q=1.", "foo", "foo;q=1", "foo", {}, {}, 1000},
+      {"foo;q=0.2501",
+       "foo;q=0.2501",
+       "foo;q=0.2501;q=1",
+       "foo",
+       {"q=0.2501"},
+       {},
+       1000},
+      {"foo;q=2", "foo;q=2", "foo;q=2;q=1", "foo", {"q=2"}, {}, 1000},
       {"text/html;level=1",
        "text/html;level=1",
        "text/html;level=1;q=1",
@@ -356,6 +368,98 @@ bool testFullNegotiation(std::ostream &log) {
           << "', expected '" << tt.rresult << "'.\n";
       return false;
     }
+    const std::string v3 = negotiate(tt.theirs, negotiator(tt.mine));
+    const std::string v4 = negotiate(tt.mine, negotiator(tt.theirs));
+    if (v3 != tt.result || v4 != tt.rresult) {
+      log << "negotiating with a negotiator produced '" << v3 << "' and '"
+          << v4 << "', expected '" << tt.result << "' and '" << tt.rresult
+          << "'.\n";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/* Test remembering negotiation results.
+ * @log Test output stream.
+ *
+ * Negotiates a few headers over and over with a small cache, checking both the
+ * results and whether they were remembered. Other threads, and copies of the
+ * negotiator, need to remember results on their own, but the number of hits
+ * and misses covers all threads.
+ *
+ * @return 'true' on success, 'false' otherwise.
+ */
+bool testNegotiatorCache(std::ostream &log) {
+  struct sampleData {
+    std::string theirs;
+    bool hit;
+  };
+
+  std::vector<sampleData> tests{
+      {"text/html", false},
+      {"text/html", true},
+      {"", false},
+      {"text/*", false},
+      {"text/html", true},
+      {"*/*;q=0.8", false},
+      {"text/html", false},
+      {"*/*;q=0.8", true},
+  };
+
+  const std::string mine = "text/plain, text/html;q=0.9";
+  negotiator n(mine);
+  n.cacheSize = 2;
+  std::size_t hits = 0, misses = 0;
+
+  for (const auto &tt : tests) {
+    const std::string v = negotiate(tt.theirs, n);
+    const std::string e = negotiate(tt.theirs, mine);
+
+    if (!tt.theirs.empty()) {
+      (tt.hit ? hits : misses)++;
+    }
+
+    if (v != e) {
+      log << "negotiate('" << tt.theirs << "') with a negotiator = '" << v
+          << "', expected '" << e << "'\n";
+      return false;
+    }
+
+    if (n.hits() != hits || n.misses() != misses) {
+      log << "negotiate('" << tt.theirs << "'): " << n.hits() << " hits and "
+          << n.misses() << " misses, expected " << hits << " and " << misses
+          << "\n";
+      return false;
+    }
+  }
+
+  // other threads remember results on their own, but count towards the total.
+  std::vector<std::thread> threads;
+  for (std::size_t t = 0; t < 4; t++) {
+    threads.emplace_back([&n] {
+      negotiate("*/*;q=0.8", n);
+      negotiate("*/*;q=0.8", n);
+    });
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+
+  if (n.hits() != hits + 4 || n.misses() != misses + 4) {
+    log << "after other threads: " << n.hits() << " hits and " << n.misses()
+        << " misses, expected " << (hits + 4) << " and " << (misses + 4)
+        << "\n";
+    return false;
+  }
+
+  // copies don't share remembered results.
+  negotiator copy(n);
+  negotiate("*/*;q=0.8", copy);
+  if (copy.hits() != 0 || copy.misses() != 1) {
+    log << "copy of a negotiator should not have remembered results\n";
+    return false;
   }
 
   return true;
@@ -370,4 +474,5 @@ static function qValueLessThan(testQvalueLessThan);
 static function qValueSort(testQvalueSort);
 static function qValueMatch(testQvalueMatch);
 static function fullNegotiation(testFullNegotiation);
+static function negotiatorCache(testNegotiatorCache);
 }
@@ -229,7 +229,10 @@ bool testRecycling(std::ostream &log) {
     }
 
     c.pending = true;
-    s->free = true;
+    if (!c.release(s) || !s->free) {
+      log << "released session should have been pooled and tagged as free.\n";
+      return false;
+    }
 
     if (c.idle()) {
       log << "connection should not be idle after setting the pending flag.\n";
@@ -252,9 +255,138 @@ bool testRecycling(std::ostream &log) {
   return true;
 }
 
+/* Test the session pool.
+ * @log Test output stream.
+ *
+ * Released sessions are reused, up to the pool's limit, and the connection
+ * keeps count of all that.
+ *
+ * @return 'true' on success, 'false' otherwise.
+ */
+bool testPool(std::ostream &log) {
+  service io;
+  struct acc {
+    acc(const service &){};
+  };
+  struct tr {
+    using endpoint = int;
+    using acceptor = acc;
+  };
+  struct proc {};
+  struct sess;
+
+  using conn = net::connection<sess, proc>;
+  struct sess {
+    using transportType = tr;
+
+    bool free = false;
+
+    sess(conn &c) : beacon(*this, c.sessions) {}
+
+    efgy::beacon<sess> beacon;
+  };
+
+  efgy::beacons<conn> conns;
+  conn c(conns, io);
+  c.maxPooled = 2;
+
+  std::vector<sess *> v;
+  for (int i = 0; i < 3; i++) {
+    v.push_back(c.getSession());
+  }
+
+  if (c.created != 3 || c.reused != 0) {
+    log << "expected 3 new sessions, got " << c.created << " new and "
+        << c.reused << " reused.\n";
+    return false;
+  }
+
+  if (!c.release(v[0]) || !c.release(v[1]) || c.release(v[2])) {
+    log << "expected only 2 sessions to fit in the pool.\n";
+    return false;
+  }
+
+  if (c.pooledSessions() != 2 || c.idle()) {
+    log << "expected 2 pooled sessions and one that's still around.\n";
+    return false;
+  }
+
+  c.discard(v[2]);
+
+  if (c.sessions.size() != 2 || c.discarded != 1 || !c.idle()) {
+    log << "discarding a session should have deleted it.\n";
+    return false;
+  }
+
+  // the pool is a stack, so the most recently released session comes first.
+  if (c.getSession() != v[1] || c.getSession() != v[0] || v[0]->free) {
+    log << "expected pooled sessions to be reused.\n";
+    return false;
+  }
+
+  if (c.created != 3 || c.reused != 2 || c.pooledSessions() != 0) {
+    log << "expected 3 new and 2 reused sessions, got " << c.created
+        << " new and " << c.reused << " reused.\n";
+    return false;
+  }
+
+  return true;
+}
+
+/* Test shard setup.
+ * @log Test output stream.
+ *
+ * Looks up a few shards' I/O services, and then binds two TCP acceptors to the
+ * same port the way separate shards would.
+ *
+ * @return 'true' on success, 'false' otherwise.
+ */
+bool testShards(std::ostream &log) {
+  if (&shard(0) != &efgy::global<service>()) {
+    log << "shard 0 should use the global I/O service.\n";
+    return false;
+  }
+
+  auto &one = shard(1);
+  auto &two = shard(2);
+  if (&one == &two || &one == &shard(0)) {
+    log << "shards should not share I/O services.\n";
+    return false;
+  }
+
+  if (&one != &shard(1)) {
+    log << "shard 1 should keep its I/O service.\n";
+    return false;
+  }
+
+#if defined(SO_REUSEPORT)
+  transport::tcp::acceptor a(one), b(two);
+  const transport::tcp::endpoint any(asio::ip::address_v4::loopback(), 0);
+
+  a.open(any.protocol());
+  net::reusePort(a);
+  a.bind(any);
+  a.listen();
+
+  asio::error_code ec;
+  b.open(any.protocol());
+  net::reusePort(b);
+  b.bind(a.local_endpoint(), ec);
+  if (ec) {
+    log << "could not bind a second shard to the same port: " << ec.message()
+        << "\n";
+    return false;
+  }
+#endif
+
+  return true;
+}
+
 namespace test {
 using efgy::test::function;
 
 static function lookup(testLookup);
 static function recycling(testRecycling);
+static function pool(testPool);
+static function shards(testShards);
 }
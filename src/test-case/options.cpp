@@ -84,7 +84,7 @@ bool testOptionsHandler(std::ostream &log) {
       return false;
     }
 
-    const auto &m = sess.outboundQueue.front();
+    const std::string m = sess.outboundQueue.front();
     if (m != tt.message) {
       log << "options() produced an unexpected message: '" << m
           << "' expected: '" << tt.message << "'\n";
@@ -44,6 +44,12 @@ bool testParse(std::ostream &log) {
        "GET /?a=b HTTP/1.1\r\n"},
       {"GET /?a=b&c=d HTTP/1.1", true, "GET", "/?a=b&c=d", "HTTP/1.1",
        "GET /?a=b&c=d HTTP/1.1\r\n"},
+      {"GET /foo HTTP/1.1\r\n", true, "GET", "/foo", "HTTP/1.1",
+       "GET /foo HTTP/1.1\r\n"},
+      {"GET  /foo HTTP/1.1", false, "", "", "HTTP/0.0", "FAIL * HTTP/0.0\r\n"},
+      {"GET /foo* HTTP/1.1", false, "", "", "HTTP/0.0", "FAIL * HTTP/0.0\r\n"},
+      {"GET /foo HTTP/1.1 ", false, "", "", "HTTP/0.0",
+       "FAIL * HTTP/0.0\r\n"},
   };
 
   for (const auto &tt : tests) {
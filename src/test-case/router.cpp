@@ -0,0 +1,376 @@
+/* Test cases for the servlet routing index.
+ *
+ * The index must never leave out a servlet that would have matched, and must
+ * keep the servlets in the order they would have been tried in otherwise.
+ *
+ * See also:
+ * * Project Documentation: https://ef.gy/documentation/cxxhttp
+ * * Project Source Code: https://github.com/ef-gy/cxxhttp
+ * * Licence Terms: https://github.com/ef-gy/cxxhttp/blob/master/COPYING
+ *
+ * @copyright
+ * This file is part of the cxxhttp project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ */
+
+#define ASIO_DISABLE_THREADS
+#include <ef.gy/test-case.h>
+
+#include <atomic>
+#include <thread>
+
+#include <cxxhttp/http-router.h>
+
+using namespace cxxhttp;
+
+/* Test literal prefix extraction.
+ * @log Test output stream.
+ *
+ * Analyses some regexen and checks that their literal prefix is as expected.
+ *
+ * @return 'true' on success, 'false' otherwise.
+ */
+bool testLiteralPrefix(std::ostream &log) {
+  struct sampleData {
+    std::string regex, prefix;
+    bool exact;
+  };
+
+  std::vector<sampleData> tests{
+      {"", "", true},
+      {".*", "", false},
+      {"/", "/", true},
+      {"^/$", "/", true},
+      {"/robots\\.txt", "/robots.txt", true},
+      {"/api/(.*)", "/api/", false},
+      {"/api/v[12]/.*", "/api/v", false},
+      {"/foo?", "/fo", false},
+      {"/foo*bar", "/fo", false},
+      {"/foo+", "/fo", false},
+      {"/foo{2}", "/fo", false},
+      {"/foo\\d+", "/foo", false},
+      {"/a\\?b=c", "/a?b=c", true},
+      {"^\\*|/.*", "", false},
+      {"/(a|b)", "/", false},
+      {"/[|]", "/", false},
+      {"/a\\|b", "/a|b", true},
+      {"/a$b", "/a", false},
+  };
+
+  for (const auto &tt : tests) {
+    const auto v = http::literalPrefix(tt.regex);
+    if (v.prefix != tt.prefix || v.exact != tt.exact) {
+      log << "literalPrefix('" << tt.regex << "')=('" << v.prefix << "', "
+          << v.exact << "), expected ('" << tt.prefix << "', " << tt.exact
+          << ")\n";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/* Test servlet routing.
+ * @log Test output stream.
+ *
+ * Sets up a bunch of servlets and, for a number of requests, checks that the
+ * servlets whose resource regex matches are the same, and in the same order,
+ * whether we look at all servlets or only the ones the router suggests. Some of
+ * the regexen use back-references, so they can't be compiled into the
+ * automaton and end up in the literal prefix index instead. Only servlets that
+ * ask for it are matched against the query.
+ *
+ * @return 'true' on success, 'false' otherwise.
+ */
+bool testRouting(std::ostream &log) {
+  const std::vector<std::string> resources{
+      "/",          "/.*",        "^\\*|/.*",    ".*",
+      "/robots\\.txt", "/api/(.*)", "/api/v1/.*", "/api/v1/user/([0-9]+)",
+      "/a\\?b=c",   "/a",         "/ab?",        "/(x|y)/z",
+      "/q.+",       "/(b)\\1[?].*", "/(a)\\1",  "/api/(v)\\1/.*",
+  };
+
+  const std::vector<std::string> requests{
+      "/",       "/robots.txt", "/robots.txt?x", "/api/",   "/api/v1/user/12",
+      "/api/v2", "/a",          "/a?b=c",        "/ab",     "/x/z",
+      "/y/z",    "*",           "",              "/nothing",
+      "/aa",     "/api/vv/x",   "/q",            "/q?",     "/bb",
+      "/bb?x",
+  };
+
+  efgy::beacons<http::servlet> servlets;
+  std::vector<std::unique_ptr<http::servlet>> owner;
+  for (const auto &r : resources) {
+    owner.emplace_back(new http::servlet(
+        r, [](http::sessionData &, std::smatch &) {}, "GET", {}, r, servlets));
+    // this one needs to look at the query, but doesn't have a '?' to show it.
+    owner.back()->matchQuery = owner.back()->matchQuery || r == "/q.+";
+  }
+
+  http::router router;
+  router.update(servlets);
+
+  for (const auto &req : requests) {
+    const auto q = req.find('?');
+    const std::string resource = req.substr(0, q);
+    const std::string resourceAndQuery =
+        q == std::string::npos ? req + "?" : req;
+
+    std::vector<const http::servlet *> all, routed;
+
+    for (const auto &s : servlets) {
+      if (std::regex_match(resource, s->resource) ||
+          (s->matchQuery && std::regex_match(resourceAndQuery, s->resource))) {
+        all.push_back(s);
+      }
+    }
+
+    for (const auto &r : router.match(resource, resourceAndQuery)) {
+      if ((r.resource && std::regex_match(resource, r.target->resource)) ||
+          (r.query && std::regex_match(resourceAndQuery, r.target->resource))) {
+        routed.push_back(r.target);
+      }
+    }
+
+    if (all != routed) {
+      log << "routing '" << req << "' produced " << routed.size()
+          << " matches, but there should have been " << all.size() << "\n";
+      return false;
+    }
+  }
+
+  // removing a servlet must be picked up by the router.
+  const auto before = router.match("/api/vv/x", "/api/vv/x?").size();
+  owner.pop_back();
+  router.update(servlets);
+  if (router.match("/api/vv/x", "/api/vv/x?").size() != before - 1) {
+    log << "router was not updated after removing a servlet\n";
+    return false;
+  }
+
+  // without any servlets that want the query, we shouldn't even look at it.
+  efgy::beacons<http::servlet> paths;
+  http::servlet path("/a.*", [](http::sessionData &, std::smatch &) {}, "GET",
+                     {}, "", paths);
+  http::router pathRouter;
+  pathRouter.update(paths);
+  const auto v = pathRouter.resolve("/a", "b");
+  if (!v->resourceAndQuery.empty() || v->servlets.size() != 1) {
+    log << "router looked at the query, but no servlet wants it\n";
+    return false;
+  }
+
+  return true;
+}
+
+/* Test the resolution cache.
+ * @log Test output stream.
+ *
+ * Resolves a sequence of requests with a small cache, and checks the hit and
+ * miss counts as well as that the cached resolutions are the same as fresh
+ * ones.
+ *
+ * @return 'true' on success, 'false' otherwise.
+ */
+bool testCache(std::ostream &log) {
+  struct sampleData {
+    std::string resource, query;
+    bool hit;
+  };
+
+  std::vector<sampleData> tests{
+      {"/a", "", false},   {"/a", "", true},    {"/b/1", "", false},
+      {"/a", "", true},    {"/a", "x", false},  {"/b/1", "", false},
+      {"/a?", "", false},  {"/a", "?", false},  {"/a?", "", true},
+  };
+
+  efgy::beacons<http::servlet> servlets;
+  const auto handler = [](http::sessionData &, std::smatch &) {};
+  http::servlet a("/a", handler, "GET", {}, "", servlets);
+  http::servlet b("/b/([0-9]+)", handler, "GET", {}, "", servlets);
+  http::servlet c("/(.*)\\?(.*)", handler, "GET", {}, "", servlets);
+  http::servlet d("/(.*)\\1", handler, "GET", {}, "", servlets);
+
+  http::router cached, fresh;
+  cached.cacheSize = 2;
+  cached.update(servlets);
+  fresh.update(servlets);
+
+  std::size_t hits = 0, misses = 0;
+  for (const auto &tt : tests) {
+    const std::string resourceAndQuery = tt.resource + "?" + tt.query;
+    const auto v = cached.resolve(tt.resource, tt.query);
+    const auto e = fresh.resolve(tt.resource, tt.query);
+
+    (tt.hit ? hits : misses)++;
+    if (cached.hits != hits || cached.misses != misses) {
+      log << "resolving '" << tt.resource << "' with query '" << tt.query
+          << "': " << cached.hits << " hits and " << cached.misses
+          << " misses, expected " << hits << " and " << misses << "\n";
+      return false;
+    }
+
+    bool same = v->servlets.size() == e->servlets.size();
+    for (std::size_t i = 0; same && i < v->servlets.size(); i++) {
+      const auto &x = v->servlets[i], &y = e->servlets[i];
+      same = x.first == y.first && x.second.size() == y.second.size();
+      for (std::size_t j = 0; same && j < x.second.size(); j++) {
+        same = x.second[j] == y.second[j];
+      }
+    }
+    if (!same) {
+      log << "cached resolution of '" << resourceAndQuery
+          << "' does not match a fresh one\n";
+      return false;
+    }
+  }
+
+  if (fresh.hits != 0 || fresh.misses != 0) {
+    log << "router without cache counted hits or misses\n";
+    return false;
+  }
+
+  // updating without any changes to the servlets must keep the cache.
+  cached.update(servlets);
+  cached.resolve("/a?", "");
+  if (cached.hits != ++hits) {
+    log << "cache was dropped without any changes to the servlets\n";
+    return false;
+  }
+
+  // changing the servlets must drop the cache.
+  {
+    http::servlet e("/a", handler, "POST", {}, "", servlets);
+    cached.update(servlets);
+    const auto v = cached.resolve("/a", "");
+    if (cached.hits != hits || v->servlets.size() != 3) {
+      log << "cache was not dropped after adding a servlet\n";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/* Test resolving on several threads.
+ * @log Test output stream.
+ *
+ * Resolves the same requests on a few threads at once, with and without the
+ * cache. Every resolution needs to come out the same as it does on a single
+ * thread.
+ *
+ * @return 'true' on success, 'false' otherwise.
+ */
+bool testConcurrent(std::ostream &log) {
+  const std::vector<std::string> requests{
+      "/", "/a", "/b/12", "/b/x", "/c/d", "/aa", "/a?b", "/nothing",
+  };
+
+  efgy::beacons<http::servlet> servlets;
+  const auto handler = [](http::sessionData &, std::smatch &) {};
+  http::servlet a("/a", handler, "GET", {}, "", servlets);
+  http::servlet b("/b/([0-9]+)", handler, "GET", {}, "", servlets);
+  http::servlet c("/(.*)\\1", handler, "GET", {}, "", servlets);
+  http::servlet d("/([a-z])/.*", handler, "GET", {}, "", servlets);
+
+  for (const std::size_t cacheSize : {0, 4}) {
+    http::router expected, router;
+    router.cacheSize = cacheSize;
+    expected.update(servlets);
+    router.update(servlets);
+
+    std::vector<std::size_t> counts;
+    for (const auto &r : requests) {
+      counts.push_back(expected.resolve(r, "")->servlets.size());
+    }
+
+    std::vector<std::thread> threads;
+    std::vector<char> ok(4, true);
+    for (std::size_t t = 0; t < ok.size(); t++) {
+      threads.emplace_back([&, t] {
+        for (std::size_t i = 0; i < 200; i++) {
+          const std::size_t n = (i + t) % requests.size();
+          router.update(servlets);
+          if (router.resolve(requests[n], "")->servlets.size() != counts[n]) {
+            ok[t] = false;
+          }
+        }
+      });
+    }
+    for (auto &t : threads) {
+      t.join();
+    }
+
+    for (std::size_t t = 0; t < ok.size(); t++) {
+      if (!ok[t]) {
+        log << "thread " << t << " resolved requests differently, with a cache"
+            << " size of " << cacheSize << "\n";
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+/* Test resolving while servlets come and go.
+ * @log Test output stream.
+ *
+ * One thread keeps creating and destroying a servlet, while others resolve
+ * requests that it doesn't match. The router needs to keep up with the set of
+ * servlets, without ever seeing it change halfway through a rebuild.
+ *
+ * @return 'true' on success, 'false' otherwise.
+ */
+bool testChurn(std::ostream &log) {
+  efgy::beacons<http::servlet> servlets;
+  const auto handler = [](http::sessionData &, std::smatch &) {};
+  http::servlet a("/a", handler, "GET", {}, "", servlets);
+  http::servlet b("/(a)\\1", handler, "GET", {}, "", servlets);
+
+  http::router router;
+  std::atomic<bool> done{false};
+  std::vector<char> ok(3, true);
+  std::vector<std::thread> threads;
+
+  for (std::size_t t = 0; t < ok.size(); t++) {
+    threads.emplace_back([&, t] {
+      while (!done) {
+        router.update(servlets);
+        const bool v = router.resolve("/a", "")->servlets.size() == 1 &&
+                       router.resolve("/aa", "")->servlets.size() == 1;
+        ok[t] = ok[t] && v;
+      }
+    });
+  }
+
+  for (std::size_t i = 0; i < 200; i++) {
+    http::servlet churn("/churn/" + std::to_string(i), handler, "GET", {}, "",
+                        servlets);
+  }
+  done = true;
+
+  for (auto &t : threads) {
+    t.join();
+  }
+
+  for (std::size_t t = 0; t < ok.size(); t++) {
+    if (!ok[t]) {
+      log << "thread " << t << " resolved requests wrongly while servlets "
+          << "were being created and destroyed\n";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+namespace test {
+using efgy::test::function;
+
+static function literalPrefix(testLiteralPrefix);
+static function routing(testRouting);
+static function cache(testCache);
+static function concurrent(testConcurrent);
+static function churn(testChurn);
+}
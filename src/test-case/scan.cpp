@@ -0,0 +1,168 @@
+/* Test cases for the delimiter scanner.
+ *
+ * The vectorised scanners need to find exactly the same delimiters as the plain
+ * loop, no matter where in a block the delimiter happens to be.
+ *
+ * See also:
+ * * Project Documentation: https://ef.gy/documentation/cxxhttp
+ * * Project Source Code: https://github.com/ef-gy/cxxhttp
+ * * Licence Terms: https://github.com/ef-gy/cxxhttp/blob/master/COPYING
+ *
+ * @copyright
+ * This file is part of the cxxhttp project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ */
+
+#include <ef.gy/test-case.h>
+
+#include <cxxhttp/scan.h>
+
+using namespace cxxhttp;
+
+/* Test delimiter search.
+ * @log Test output stream.
+ *
+ * Runs all the delimiter search implementations that the CPU supports over
+ * buffers of different sizes, with the delimiter in every possible position,
+ * and compares the results to what they should be.
+ *
+ * @return 'true' on success, 'false' otherwise.
+ */
+bool testFind(std::ostream &log) {
+  struct sampleData {
+    const char *name;
+    scan::finder find;
+  };
+
+  std::vector<sampleData> tests{
+      {"scalar", scan::findScalar},
+#if defined(CXXHTTP_SCAN_X86) && defined(__SSE2__)
+      {"SSE2", scan::findSSE2},
+#endif
+  };
+
+#if defined(CXXHTTP_SCAN_X86)
+  if (__builtin_cpu_supports("avx2")) {
+    tests.push_back({"AVX2", scan::findAVX2});
+  }
+#endif
+
+  for (const auto &tt : tests) {
+    for (std::size_t size = 0; size < 100; size++) {
+      std::string s(size, 'x');
+      if (tt.find(s.data(), s.size(), ':', '\n') != stringView::npos) {
+        log << tt.name << ": found a delimiter in '" << s << "'\n";
+        return false;
+      }
+
+      for (std::size_t pos = 0; pos < size; pos++) {
+        s[pos] = pos % 2 ? ':' : '\n';
+        const auto v = tt.find(s.data(), s.size(), ':', '\n');
+        if (v != pos) {
+          log << tt.name << ": found delimiter at " << v << ", expected " << pos
+              << " in a buffer of " << size << " bytes\n";
+          return false;
+        }
+        s[pos] = '\x80';
+      }
+    }
+  }
+
+  return true;
+}
+
+/* Test control character search.
+ * @log Test output stream.
+ *
+ * Like testFind(), but for the control character search. Every byte value is
+ * placed in every possible position, and the vectorised versions need to agree
+ * with the plain loop.
+ *
+ * @return 'true' on success, 'false' otherwise.
+ */
+bool testFindControl(std::ostream &log) {
+  struct sampleData {
+    const char *name;
+    scan::controlFinder find;
+  };
+
+  std::vector<sampleData> tests{
+      {"scalar", scan::findControlScalar},
+#if defined(CXXHTTP_SCAN_X86) && defined(__SSE2__)
+      {"SSE2", scan::findControlSSE2},
+#endif
+  };
+
+#if defined(CXXHTTP_SCAN_X86)
+  if (__builtin_cpu_supports("avx2")) {
+    tests.push_back({"AVX2", scan::findControlAVX2});
+  }
+#endif
+
+  for (const auto &tt : tests) {
+    for (std::size_t size = 0; size < 70; size++) {
+      std::string s(size, '\t');
+      for (std::size_t pos = 0; pos < size; pos++) {
+        for (unsigned c = 0; c < 256; c++) {
+          s[pos] = char(c);
+          const auto v = tt.find(s.data(), s.size());
+          const auto e = scan::isControl(c) ? pos : stringView::npos;
+          if (v != e) {
+            log << tt.name << ": found control character at " << v
+                << ", expected " << e << " for character " << c
+                << " in a buffer of " << size << " bytes\n";
+            return false;
+          }
+        }
+        s[pos] = 'x';
+      }
+    }
+  }
+
+  return true;
+}
+
+/* Test header block termination search.
+ * @log Test output stream.
+ *
+ * Looks for the end of some header blocks, which may or may not be complete.
+ *
+ * @return 'true' on success, 'false' otherwise.
+ */
+bool testHeaderEnd(std::ostream &log) {
+  struct sampleData {
+    std::string in;
+    std::size_t out;
+  };
+
+  std::vector<sampleData> tests{
+      {"", stringView::npos},
+      {"\n", stringView::npos},
+      {"\n\n", 2},
+      {"\r\n\r\n", 4},
+      {"GET / HTTP/1.1\r\nHost: a\r\n\r\n", 27},
+      {"GET / HTTP/1.1\r\nHost: a\r\n\r\nGET / HTTP/1.1\r\n\r\n", 27},
+      {"GET / HTTP/1.1\r\nHost: a\r\n\r", stringView::npos},
+      {"GET / HTTP/1.1\r\nHost: a\r\n \r\n", stringView::npos},
+      {"GET / HTTP/1.1\nHost: " + std::string(100, 'a') + "\n\n", 123},
+  };
+
+  for (const auto &tt : tests) {
+    const auto v = scan::headerEnd(tt.in);
+    if (v != tt.out) {
+      log << "scan::headerEnd('" << tt.in << "')=" << v << ", expected "
+          << tt.out << "\n";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+namespace test {
+using efgy::test::function;
+
+static function find(testFind);
+static function findControl(testFindControl);
+static function headerEnd(testHeaderEnd);
+}
@@ -0,0 +1,459 @@
+/* Test cases for servlets.
+ *
+ * Servlets are run by the server processor, so these tests set up a processor
+ * with a few servlets and look at the replies it produces.
+ *
+ * See also:
+ * * Project Documentation: https://ef.gy/documentation/cxxhttp
+ * * Project Source Code: https://github.com/ef-gy/cxxhttp
+ * * Licence Terms: https://github.com/ef-gy/cxxhttp/blob/master/COPYING
+ *
+ * @copyright
+ * This file is part of the cxxhttp project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ */
+
+#define ASIO_DISABLE_THREADS
+#include <ef.gy/test-case.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <cxxhttp/http-processor.h>
+
+using namespace cxxhttp;
+
+/* Test pre-rendered replies.
+ * @log Test output stream.
+ *
+ * A static servlet needs to produce the same replies as a regular servlet with
+ * the same content would, only without doing the work for every request.
+ *
+ * @return 'true' on success, 'false' otherwise.
+ */
+bool testStaticServlet(std::ostream &log) {
+  struct sampleData {
+    std::string request, accept;
+    bool replied;
+  };
+
+  std::vector<sampleData> tests{
+      {"GET /static HTTP/1.1", "", true},
+      {"GET /static HTTP/1.1", "text/plain", true},
+      {"GET /static HTTP/1.1", "application/json", true},
+      {"GET /static HTTP/1.1", "application/json;q=0.5, text/*", true},
+      {"GET /static HTTP/1.1", "text/html", false},
+      {"HEAD /static HTTP/1.1", "", true},
+      {"HEAD /static HTTP/1.1", "application/json", true},
+      {"POST /static HTTP/1.1", "", false},
+  };
+
+  const http::headers header{{"Cache-Control", "max-age=60"}};
+  const std::string plain = "hello world\n";
+  const std::string json = "{\"hello\":\"world\"}";
+
+  http::processor::server statics, dynamics;
+
+  http::staticServlet s("/static",
+                        {{"text/plain", plain}, {"application/json", json}},
+                        header, "static", statics.servlets);
+
+  http::servlet d(
+      "/static",
+      [&](http::sessionData &session, std::smatch &) {
+        const auto type = session.negotiated["Accept"];
+        session.reply(200, type == "text/plain" ? plain : json, header);
+      },
+      "GET", {{"Accept", "text/plain, application/json"}}, "dynamic",
+      dynamics.servlets);
+
+  for (const auto &tt : tests) {
+    http::sessionData a, b;
+
+    a.inboundRequest = b.inboundRequest = tt.request;
+    if (!tt.accept.empty()) {
+      a.inbound.header["Accept"] = b.inbound.header["Accept"] = tt.accept;
+    }
+
+    statics.handle(a);
+    dynamics.handle(b);
+
+    if (a.outboundQueue.size() != 1 || b.outboundQueue.size() != 1) {
+      log << "expected exactly one reply to '" << tt.request << "'\n";
+      return false;
+    }
+
+    const std::string va = a.outboundQueue.front();
+    const std::string vb = b.outboundQueue.front();
+
+    if (va != vb) {
+      log << "static reply to '" << tt.request << "' with Accept: " << tt.accept
+          << " was:\n"
+          << va << "\nbut expected:\n"
+          << vb << "\n";
+      return false;
+    }
+
+    if ((va.compare(0, 15, "HTTP/1.1 200 OK") == 0) != tt.replied) {
+      log << "unexpected reply to '" << tt.request << "':\n" << va << "\n";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/* Test dispatching to static servlets while they're being set up.
+ * @log Test output stream.
+ *
+ * A static servlet can be dispatched to as soon as it's registered, so its
+ * replies need to be rendered before that. Requests made for servlets while
+ * they're being added should either not find them, or get the full reply.
+ *
+ * @return 'true' on success, 'false' otherwise.
+ */
+bool testStaticServletSetup(std::ostream &log) {
+  http::processor::server server;
+  const std::size_t count = 50;
+  const http::staticServlet::variants variants{{"text/plain", "hello\n"}};
+  std::vector<std::unique_ptr<http::staticServlet>> servlets;
+  std::atomic<bool> done{false};
+  std::size_t bad = 0;
+
+  // so that requests get a 404 rather than a 501 before any of the others.
+  servlets.emplace_back(new http::staticServlet("/static", variants, {},
+                                                "static", server.servlets));
+
+  std::thread requests([&] {
+    for (std::size_t i = 0; !done; i = (i + 1) % count) {
+      http::sessionData session;
+      session.inboundRequest =
+          std::string("GET /static/") + std::to_string(i) + " HTTP/1.1";
+      server.handle(session);
+      const std::string r = session.outboundQueue.size() == 1
+                                ? std::string(session.outboundQueue.front())
+                                : std::string();
+      if (r.compare(0, 15, "HTTP/1.1 200 OK") != 0 &&
+          r.compare(0, 22, "HTTP/1.1 404 Not Found") != 0) {
+        bad++;
+      }
+    }
+  });
+
+  for (std::size_t i = 0; i < count; i++) {
+    servlets.emplace_back(new http::staticServlet(
+        "/static/" + std::to_string(i), variants, {}, "static",
+        server.servlets));
+  }
+
+  done = true;
+  requests.join();
+
+  if (bad > 0) {
+    log << bad << " requests got neither the full reply nor a 404\n";
+    return false;
+  }
+
+  return true;
+}
+
+/* Test method matching.
+ * @log Test output stream.
+ *
+ * Servlets look up known methods in a bit mask, rather than with their method
+ * regex, so this checks that the two agree.
+ *
+ * @return 'true' on success, 'false' otherwise.
+ */
+bool testMethods(std::ostream &log) {
+  struct sampleData {
+    std::string methodx;
+    std::set<std::string> known;
+  };
+
+  std::vector<sampleData> tests{
+      {"GET", {"GET"}},
+      {"GET|POST", {"GET", "POST"}},
+      {"P.*", {"POST", "PUT"}},
+      {"FOO", {}},
+      {".*", {"CONNECT", "DELETE", "GET", "HEAD", "OPTIONS", "POST", "PUT",
+              "TRACE"}},
+  };
+
+  const std::vector<std::string> requests{
+      "GET", "HEAD", "POST", "PUT", "OPTIONS", "FOO", "FOOBAR", "get",
+  };
+
+  for (const auto &tt : tests) {
+    efgy::beacons<http::servlet> set;
+    const http::servlet s("/", [](http::sessionData &, std::smatch &) {},
+                          tt.methodx, {}, "", set);
+
+    const auto v = http::methodNames(s.methods);
+    if (v != tt.known) {
+      log << "servlet with method regex '" << tt.methodx << "' has "
+          << v.size() << " known methods, expected " << tt.known.size()
+          << "\n";
+      return false;
+    }
+
+    for (const auto &m : requests) {
+      const bool head = m == "HEAD";
+      const auto mask =
+          http::methodBit(m) | (head ? http::methodBit("GET") : 0);
+      const bool expected = std::regex_match(m, s.method) ||
+                            (head && std::regex_match("GET", s.method));
+
+      if (s.allows(m, mask) != expected) {
+        log << "servlet with method regex '" << tt.methodx
+            << "' allowing method " << m << ": " << !expected << ", expected "
+            << expected << "\n";
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+/* Test query detection.
+ * @log Test output stream.
+ *
+ * Servlets only get to match the query if their resource regex has a literal
+ * question mark, unless they're told otherwise.
+ *
+ * @return 'true' on success, 'false' otherwise.
+ */
+bool testMentionsQuery(std::ostream &log) {
+  struct sampleData {
+    std::string resourcex;
+    bool query;
+  };
+
+  std::vector<sampleData> tests{
+      {"/", false},          {"/.*", false},       {"/a?", false},
+      {"/a\\?b", true},      {"/a[?]b", true},     {"/a[^?]b", true},
+      {"/a\\\\?", false},    {"/a[\\]?]", true},   {"/a[\\]]?", false},
+      {"/(?:a)", false},
+  };
+
+  for (const auto &tt : tests) {
+    const bool v = http::mentionsQuery(tt.resourcex);
+    if (v != tt.query) {
+      log << "mentionsQuery('" << tt.resourcex << "')=" << v << ", expected "
+          << tt.query << "\n";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/* Test blocking servlets.
+ * @log Test output stream.
+ *
+ * Handlers of blocking servlets are run on a worker pool, and the request is
+ * deferred until then. The tests here resume the request on the test's own
+ * thread, like the flow would on the session's strand.
+ *
+ * @return 'true' on success, 'false' otherwise.
+ */
+bool testBlocking(std::ostream &log) {
+  struct sampleData {
+    std::string request;
+    bool deferred;
+    std::string status;
+  };
+
+  std::vector<sampleData> tests{
+      {"GET /blocking HTTP/1.1", true, "HTTP/1.1 200 OK"},
+      {"GET /silent HTTP/1.1", true, "HTTP/1.1 405 Method Not Allowed"},
+      {"GET /fallback HTTP/1.1", true, "HTTP/1.1 200 OK"},
+      {"POST /blocking HTTP/1.1", false, "HTTP/1.1 501 Not Implemented"},
+  };
+
+  http::processor::server proc;
+  workers pool;
+  pool.threads = 1;
+  proc.pool = &pool;
+
+  http::servlet blocking("/blocking", [](http::sessionData &sess,
+                                         std::smatch &) {
+    sess.reply(200, "blocked");
+  }, "GET", {}, "", proc.servlets);
+  http::servlet silent("/silent|/fallback",
+                       [](http::sessionData &, std::smatch &) {}, "GET", {},
+                       "", proc.servlets);
+  http::servlet fallback("/fallback", [](http::sessionData &sess,
+                                         std::smatch &) {
+    sess.reply(200, "fallback");
+  }, "GET", {}, "", proc.servlets);
+  blocking.blocking = silent.blocking = fallback.blocking = true;
+
+  std::mutex lock;
+  std::condition_variable resumed;
+  std::function<void(void)> then;
+
+  for (const auto &tt : tests) {
+    http::sessionData sess;
+    sess.inboundRequest = tt.request;
+    sess.resume = [&](std::function<void(void)> pThen) {
+      std::lock_guard<std::mutex> guard(lock);
+      then = pThen;
+      resumed.notify_one();
+    };
+
+    sess.status = http::stProcessing;
+    proc.handle(sess);
+
+    if ((sess.status == http::stDeferred) != tt.deferred) {
+      log << "request '" << tt.request << "' deferred: " << !tt.deferred
+          << ", expected " << tt.deferred << "\n";
+      return false;
+    }
+
+    // resuming may defer the request again, if the next servlet blocks too.
+    while (sess.status == http::stDeferred) {
+      std::unique_lock<std::mutex> guard(lock);
+      resumed.wait(guard, [&] { return bool(then); });
+      const auto next = then;
+      then = nullptr;
+      guard.unlock();
+
+      sess.status = http::stProcessing;
+      next();
+    }
+
+    if (sess.outboundQueue.size() != 1) {
+      log << "expected exactly one reply to '" << tt.request << "', got "
+          << sess.outboundQueue.size() << "\n";
+      return false;
+    }
+
+    const std::string v = sess.outboundQueue.front();
+    if (v.compare(0, tt.status.size(), tt.status) != 0) {
+      log << "unexpected reply to '" << tt.request << "':\n" << v << "\n";
+      return false;
+    }
+  }
+
+  // with a full queue, requests for blocking servlets are turned down.
+  pool.queueLimit = 0;
+  http::sessionData sess;
+  sess.inboundRequest = std::string("GET /blocking HTTP/1.1");
+  sess.resume = [](std::function<void(void)>) {};
+  sess.status = http::stProcessing;
+  proc.handle(sess);
+
+  const std::string unavailable = "HTTP/1.1 503 Service Unavailable";
+  if (sess.status != http::stProcessing || sess.outboundQueue.size() != 1 ||
+      sess.outboundQueue.front().header.compare(0, unavailable.size(),
+                                                unavailable) != 0) {
+    log << "expected a 503 reply with a full worker queue\n";
+    return false;
+  }
+
+  return true;
+}
+
+/* Test blocking servlets that go away.
+ * @log Test output stream.
+ *
+ * Keeps the only worker busy while a request for a blocking servlet is queued,
+ * and destroys the servlet in the meantime. The handler must then not be run,
+ * and the request needs to be routed again, which finds nothing.
+ *
+ * @return 'true' on success, 'false' otherwise.
+ */
+bool testBlockingLifetime(std::ostream &log) {
+  http::processor::server proc;
+  workers pool;
+  pool.threads = 1;
+  proc.pool = &pool;
+
+  std::mutex lock;
+  std::condition_variable changed;
+  bool started = false, release = false, ran = false;
+  std::function<void(void)> then;
+
+  std::unique_ptr<http::servlet> gone(new http::servlet(
+      "/gone",
+      [&ran](http::sessionData &sess, std::smatch &) {
+        ran = true;
+        sess.reply(200, "still here");
+      },
+      "GET", {}, "", proc.servlets));
+  gone->blocking = true;
+  http::servlet other("/other", [](http::sessionData &, std::smatch &) {},
+                      "GET", {}, "", proc.servlets);
+
+  pool.submit([&] {
+    std::unique_lock<std::mutex> guard(lock);
+    started = true;
+    changed.notify_all();
+    changed.wait(guard, [&] { return release; });
+  });
+
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    changed.wait(guard, [&] { return started; });
+  }
+
+  http::sessionData sess;
+  sess.inboundRequest = std::string("GET /gone HTTP/1.1");
+  sess.resume = [&](std::function<void(void)> pThen) {
+    std::lock_guard<std::mutex> guard(lock);
+    then = pThen;
+    changed.notify_all();
+  };
+  sess.status = http::stProcessing;
+  proc.handle(sess);
+
+  if (sess.status != http::stDeferred) {
+    log << "request for a blocking servlet should have been deferred\n";
+    return false;
+  }
+
+  gone.reset();
+
+  std::function<void(void)> next;
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    release = true;
+    changed.notify_all();
+    changed.wait(guard, [&] { return bool(then); });
+    next = then;
+  }
+
+  sess.status = http::stProcessing;
+  next();
+
+  if (ran) {
+    log << "handler of a servlet that is gone should not have been run\n";
+    return false;
+  }
+
+  const std::string notFound = "HTTP/1.1 404 Not Found";
+  if (sess.outboundQueue.size() != 1 ||
+      sess.outboundQueue.front().header.compare(0, notFound.size(),
+                                                notFound) != 0) {
+    log << "expected a 404 reply once the servlet is gone\n";
+    return false;
+  }
+
+  return true;
+}
+
+namespace test {
+using efgy::test::function;
+
+static function staticServlet(testStaticServlet);
+static function staticServletSetup(testStaticServletSetup);
+static function methods(testMethods);
+static function mentionsQuery(testMentionsQuery);
+static function blocking(testBlocking);
+static function blockingLifetime(testBlockingLifetime);
+}
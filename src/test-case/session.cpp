@@ -101,7 +101,7 @@ bool testReply(std::ostream &log) {
   for (const auto &tt : tests) {
     http::sessionData s;
 
-    const auto &v = s.generateReply(tt.status, tt.body, tt.header);
+    const std::string v = s.generateReply(tt.status, tt.body, tt.header);
 
     if (v != tt.message) {
       log << "generateReply() = '" << v << "', but expected '" << tt.message
@@ -113,6 +113,90 @@ bool testReply(std::ostream &log) {
   return true;
 }
 
+/* Test reply buffers.
+ * @log Test output stream.
+ *
+ * Replies keep their header block and body in separate buffers, which are
+ * written together. The body buffer is empty when there's no body to send.
+ *
+ * @return 'true' on success, 'false' otherwise.
+ */
+bool testReplyBuffers(std::ostream &log) {
+  struct sampleData {
+    int status;
+    bool head;
+    std::string body;
+    std::size_t header, size;
+  };
+
+  std::vector<sampleData> tests{
+      {100, false, "ignored", 25, 0},
+      {200, false, "foo", 38, 3},
+      {200, true, "foo", 38, 0},
+      {200, false, "", 38, 0},
+  };
+
+  for (const auto &tt : tests) {
+    http::sessionData s;
+    s.isHEAD = tt.head;
+
+    const auto m = s.generateReply(tt.status, tt.body);
+    const auto b = m.buffers();
+
+    if (asio::buffer_size(b[0]) != tt.header ||
+        asio::buffer_size(b[1]) != tt.size ||
+        m.size() != tt.header + tt.size) {
+      log << "generateReply() produced buffers of " << asio::buffer_size(b[0])
+          << " and " << asio::buffer_size(b[1]) << " bytes, expected "
+          << tt.header << " and " << tt.size << "\n";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/* Test replies without copies.
+ * @log Test output stream.
+ *
+ * Bodies that are moved into a reply, or that are shared, must end up in the
+ * outbound queue as they are, rather than as copies.
+ *
+ * @return 'true' on success, 'false' otherwise.
+ */
+bool testReplyNoCopy(std::ostream &log) {
+  http::sessionData s;
+
+  std::string moved(1000, 'x');
+  const char *data = moved.data();
+  s.reply(200, std::move(moved));
+
+  const auto shared = std::make_shared<const std::string>(1000, 'y');
+  s.reply(200, shared);
+  s.reply(200, shared);
+
+  if (s.outboundQueue.size() != 3 || s.replies != 3) {
+    log << "expected 3 replies, but have " << s.outboundQueue.size() << "\n";
+    return false;
+  }
+
+  auto it = s.outboundQueue.begin();
+  if (!it->body || it->body->data() != data) {
+    log << "moved body was copied\n";
+    return false;
+  }
+
+  for (it++; it != s.outboundQueue.end(); it++) {
+    if (it->body != shared ||
+        it->header.find("Content-Length: 1000\r\n") == std::string::npos) {
+      log << "shared body was not shared: '" << std::string(*it) << "'\n";
+      return false;
+    }
+  }
+
+  return true;
+}
+
 /* Test server-side session header negotiation.
  * @log Test output stream.
  *
@@ -210,6 +294,8 @@ using efgy::test::function;
 
 static function basicSession(testBasicSession);
 static function reply(testReply);
+static function replyBuffers(testReplyBuffers);
+static function replyNoCopy(testReplyNoCopy);
 static function negotiate(testNegotiate);
 static function trigger405(testTrigger405);
 }
@@ -0,0 +1,64 @@
+/* Test cases for running shards.
+ *
+ * Shards that nobody asked for during setup still need to be created, and that
+ * needs to happen before their threads get going. Unlike the other network
+ * tests, this one is built with thread support so that those threads are real.
+ *
+ * See also:
+ * * Project Documentation: https://ef.gy/documentation/cxxhttp
+ * * Project Source Code: https://github.com/ef-gy/cxxhttp
+ * * Licence Terms: https://github.com/ef-gy/cxxhttp/blob/master/COPYING
+ *
+ * @copyright
+ * This file is part of the cxxhttp project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ */
+
+#include <ef.gy/test-case.h>
+
+#define NO_DEFAULT_OPTIONS
+#include <cxxhttp/network.h>
+
+using namespace cxxhttp;
+
+/* Test running shards that haven't been set up.
+ * @log Test output stream.
+ *
+ * None of the shards have any work, so running them should return right away,
+ * and leave every one of them created, and only once.
+ *
+ * @return 'true' on success, 'false' otherwise.
+ */
+bool testRunShards(std::ostream &log) {
+  const auto &services = efgy::global<std::deque<service>>();
+  const std::size_t before = services.size();
+  const std::size_t n = before + 8;
+
+  run(n, 1);
+
+  if (services.size() != n - 1) {
+    log << "expected " << (n - 1) << " extra shards after running " << n
+        << ", but have " << services.size() << "\n";
+    return false;
+  }
+
+  for (std::size_t i = 1; i < n; i++) {
+    if (&shard(i) != &services[i - 1]) {
+      log << "shard " << i << " is not where it should be\n";
+      return false;
+    }
+  }
+
+  if (services.size() != n - 1) {
+    log << "looking up existing shards should not create new ones\n";
+    return false;
+  }
+
+  return true;
+}
+
+namespace test {
+using efgy::test::function;
+
+static function runShards(testRunShards);
+}
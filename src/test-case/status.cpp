@@ -71,6 +71,10 @@ bool testParse(std::ostream &log) {
       {"HTTP/1.1 555 glorb\r", true, 555, "HTTP/1.1", "glorb"},
       {"HTTP/1.1 999 glorb\r", false, 999, "HTTP/1.1", "glorb"},
       {"HTTP/1.0 200 OK", true, 200, "HTTP/1.0", "OK"},
+      {"HTTP/1.1 204 \r\n", true, 204, "HTTP/1.1", ""},
+      {"HTTP/1.1 204\r\n", false, 0, "", ""},
+      {"HTTP/1.1 20x OK", false, 0, "", ""},
+      {"HTTP/1.1 200 O\nK", false, 0, "", ""},
   };
 
   for (const auto &tt : tests) {
@@ -40,6 +40,19 @@ bool testCompare(std::ostream &log) {
       {"a", "A", false, false},
       {"aa", "ab", true, false},
       {"aA", "Aa", false, false},
+      {"", "a", true, false},
+      {"a", "_", false, true},
+      {"A", "_", false, true},
+      {"Content-Length", "content-length", false, false},
+      {"Content-Length", "content-lengtH", false, false},
+      {"Content-Length", "Content-Type", true, false},
+      {"Content-Length", "Content-Length2", true, false},
+      {"Accept-Encoding", "Accept-Charset", false, true},
+      {"abcdefgh@", "ABCDEFGH[", true, false},
+      {"abcdefgh@", "ABCDEFGH`", true, false},
+      {"abcdefgh\x80", "ABCDEFGHz", false, true},
+      {"abcdefgh\xc1", "ABCDEFGH\xe1", true, false},
+      {"abcdefg\xc1X", "ABCDEFG\xc1x", false, false},
   };
 
   for (const auto &tt : tests) {
@@ -60,8 +73,111 @@ bool testCompare(std::ostream &log) {
   return true;
 }
 
+/* Test case-insensitive equality and hashes.
+ * @log Test output stream.
+ *
+ * Strings that are equal without regard to case need to be equal according to
+ * caseInsensitiveEQ, and have the same hash. Also makes sure the compile-time
+ * hash is the same as the one at run time.
+ *
+ * @return 'true' on success, 'false' otherwise.
+ */
+bool testEqual(std::ostream &log) {
+  struct sampleData {
+    std::string a, b;
+    bool res;
+  };
+
+  std::vector<sampleData> tests{
+      {"", "", true},
+      {"a", "A", true},
+      {"a", "b", false},
+      {"a", "aa", false},
+      {"@", "`", false},
+      {"[", "{", false},
+      {"Content-Length", "CONTENT-LENGTH", true},
+      {"Content-Length", "Content-Lengti", false},
+      {"Content-Length", "Content_Length", false},
+      {"abcdefgh\xc1", "ABCDEFGH\xe1", false},
+  };
+
+  for (const auto &tt : tests) {
+    const auto v = caseInsensitiveEQ()(tt.a, tt.b);
+    if (v != tt.res) {
+      log << "caseInsensitiveEQ('" << tt.a << "', '" << tt.b << "')='" << v
+          << "', expected '" << tt.res << "'\n";
+      return false;
+    }
+    const auto ha = caseInsensitiveHash()(tt.a);
+    const auto hb = caseInsensitiveHash()(tt.b);
+    if (v && ha != hb) {
+      log << "caseInsensitiveHash('" << tt.a << "')=" << ha
+          << ", but caseInsensitiveHash('" << tt.b << "')=" << hb << "\n";
+      return false;
+    }
+    if (ha != caseInsensitiveHash::hash(tt.a.c_str())) {
+      log << "caseInsensitiveHash('" << tt.a << "')=" << ha
+          << ", but at compile time it is "
+          << caseInsensitiveHash::hash(tt.a.c_str()) << "\n";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/* Test string views.
+ * @log Test output stream.
+ *
+ * Slices up some strings with views, and makes sure that the results compare
+ * the same way the equivalent std::string operations would.
+ *
+ * @return 'true' on success, 'false' otherwise.
+ */
+bool testView(std::ostream &log) {
+  struct sampleData {
+    std::string in;
+    std::size_t pos, n;
+    std::string sub;
+    char find;
+    std::size_t found;
+  };
+
+  std::vector<sampleData> tests{
+      {"", 0, 1, "", 'a', stringView::npos},
+      {"foo bar", 0, 3, "foo", ' ', 3},
+      {"foo bar", 4, stringView::npos, "bar", 'r', 6},
+      {"foo bar", 5, 10, "ar", 'x', stringView::npos},
+      {"foo bar", 10, 1, "", 'o', 1},
+  };
+
+  for (const auto &tt : tests) {
+    const stringView v(tt.in);
+    const auto s = v.substr(tt.pos, tt.n);
+    if (s != tt.sub || std::string(s) != tt.sub) {
+      log << "stringView('" << tt.in << "').substr(" << tt.pos << ", " << tt.n
+          << ")='" << s << "', expected '" << tt.sub << "'\n";
+      return false;
+    }
+    if (v.find(tt.find) != tt.found) {
+      log << "stringView('" << tt.in << "').find('" << tt.find
+          << "')=" << v.find(tt.find) << ", expected " << tt.found << "\n";
+      return false;
+    }
+    if ((s < v) != (tt.sub < tt.in) || (v < s) != (tt.in < tt.sub)) {
+      log << "stringView('" << tt.in << "') ordering does not match that of "
+                                          "std::string\n";
+      return false;
+    }
+  }
+
+  return true;
+}
+
 namespace test {
 using efgy::test::function;
 
 static function compare(testCompare);
+static function equal(testEqual);
+static function view(testView);
 }
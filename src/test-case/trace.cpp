@@ -62,7 +62,7 @@ bool testTraceHandler(std::ostream &log) {
       return false;
     }
 
-    const auto &m = sess.outboundQueue.front();
+    const std::string m = sess.outboundQueue.front();
     if (m != tt.message) {
       log << "trace() produced an unexpected message: '" << m << "' expected: '"
           << tt.message << "'\n";
@@ -42,6 +42,22 @@ bool testParsing(std::ostream &log) {
       {"%2", false, "", "", "", "", "", "%2"},
       {"#foo", true, "", "", "", "", "foo", "#foo"},
       {"/?a=b", true, "", "", "/", "a=b", "", "/?a=b"},
+      {"http://a/b%2Fc?d%3De#f%20g",
+       true,
+       "http",
+       "a",
+       "/b/c",
+       "d=e",
+       "f g",
+       "http://a/b%2Fc?d%3De#f%20g"},
+      {"a?b:c", true, "", "", "a", "b:c", "", "a?b:c"},
+      {"/a:b", true, "", "", "/a:b", "", "", "/a:b"},
+      {":a", true, "", "", ":a", "", "", ":a"},
+      {"mailto:a@b", true, "mailto", "", "a@b", "", "", "mailto:a@b"},
+      {"//a", true, "", "a", "", "", "", "//a"},
+      {"/?", true, "", "", "/", "", "", "/"},
+      {"/?a%", false, "", "", "", "", "", ""},
+      {"#a\nb", false, "", "", "", "", "", ""},
   };
 
   for (const auto &tt : tests) {
@@ -78,6 +94,12 @@ bool testParsing(std::ostream &log) {
             << "', expected '" << tt.fragment << "'\n";
         return false;
       }
+      if (v.pathView() != v.path() || v.queryView() != v.query() ||
+          v.schemeView() != v.scheme() || v.authorityView() != v.authority() ||
+          v.fragmentView() != v.fragment()) {
+        log << "uri('" << tt.in << "') has views that don't match\n";
+        return false;
+      }
       if (std::string(v) != tt.out) {
         log << "uri('" << tt.in << "') = '" << std::string(v) << "', expected '"
             << tt.out << "'\n";
@@ -89,8 +111,61 @@ bool testParsing(std::ostream &log) {
   return true;
 }
 
+/* Test query parameters.
+ * @log Test output stream.
+ *
+ * Splits up some queries and checks the parameters that come out of that. The
+ * parameters are looked at in a copy of the URI, after the original is gone,
+ * to make sure they don't refer to the wrong URI.
+ *
+ * @return 'true' on success, 'false' otherwise.
+ */
+bool testParameters(std::ostream &log) {
+  struct sampleData {
+    std::string in;
+    std::vector<std::pair<std::string, std::string>> parameters;
+  };
+
+  std::vector<sampleData> tests{
+      {"/", {}},
+      {"/?", {}},
+      {"/?a=b", {{"a", "b"}}},
+      {"/?a=b&c=d", {{"a", "b"}, {"c", "d"}}},
+      {"/?a&&b=&=c", {{"a", ""}, {"b", ""}, {"", "c"}}},
+      {"/?a=b=c", {{"a", "b=c"}}},
+      {"/?a=b%26c=d&e", {{"a", "b%26c=d"}, {"e", ""}}},
+      {"/?a=b#c=d", {{"a", "b"}}},
+  };
+
+  for (const auto &tt : tests) {
+    uri v;
+    {
+      const uri u(tt.in);
+      u.parameters();
+      v = u;
+    }
+
+    std::vector<std::pair<std::string, std::string>> p;
+    for (const auto &kv : v.parameters()) {
+      p.push_back({kv.first, kv.second});
+    }
+
+    if (p != tt.parameters) {
+      log << "uri('" << tt.in << "').parameters() has " << p.size()
+          << " parameters, expected " << tt.parameters.size() << ":\n";
+      for (const auto &kv : p) {
+        log << " * '" << kv.first << "' = '" << kv.second << "'\n";
+      }
+      return false;
+    }
+  }
+
+  return true;
+}
+
 namespace test {
 using efgy::test::function;
 
 static function parsing(testParsing);
+static function parameters(testParameters);
 }
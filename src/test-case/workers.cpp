@@ -0,0 +1,126 @@
+/* Test cases for the worker thread pool.
+ *
+ * Jobs need to run, and the pool needs to turn down jobs once its queue is
+ * full.
+ *
+ * See also:
+ * * Project Documentation: https://ef.gy/documentation/cxxhttp
+ * * Project Source Code: https://github.com/ef-gy/cxxhttp
+ * * Licence Terms: https://github.com/ef-gy/cxxhttp/blob/master/COPYING
+ *
+ * @copyright
+ * This file is part of the cxxhttp project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ */
+
+#include <ef.gy/test-case.h>
+
+#include <cxxhttp/workers.h>
+
+using namespace cxxhttp;
+
+/* Test running jobs.
+ * @log Test output stream.
+ *
+ * Without threads, jobs are run right away. With threads, they're run
+ * eventually.
+ *
+ * @return 'true' on success, 'false' otherwise.
+ */
+bool testRun(std::ostream &log) {
+  {
+    workers pool;
+    pool.threads = 0;
+    bool ran = false;
+
+    if (!pool.submit([&ran] { ran = true; }) || !ran) {
+      log << "job should have run right away without threads\n";
+      return false;
+    }
+  }
+
+  std::mutex lock;
+  std::condition_variable done;
+  std::size_t count = 0;
+  const std::size_t jobs = 32;
+
+  workers pool;
+  pool.threads = 3;
+  pool.queueLimit = jobs;
+
+  for (std::size_t i = 0; i < jobs; i++) {
+    if (!pool.submit([&] {
+          std::lock_guard<std::mutex> guard(lock);
+          count++;
+          done.notify_one();
+        })) {
+      log << "job " << i << " was turned down\n";
+      return false;
+    }
+  }
+
+  std::unique_lock<std::mutex> guard(lock);
+  done.wait(guard, [&] { return count == jobs; });
+
+  return true;
+}
+
+/* Test the queue limit.
+ * @log Test output stream.
+ *
+ * Keeps the only worker busy and fills up the queue, after which jobs should be
+ * turned down until the worker gets to them.
+ *
+ * @return 'true' on success, 'false' otherwise.
+ */
+bool testQueueLimit(std::ostream &log) {
+  std::mutex lock;
+  std::condition_variable changed;
+  bool started = false, release = false;
+
+  workers pool;
+  pool.threads = 1;
+  pool.queueLimit = 2;
+
+  pool.submit([&] {
+    std::unique_lock<std::mutex> guard(lock);
+    started = true;
+    changed.notify_all();
+    changed.wait(guard, [&] { return release; });
+  });
+
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    changed.wait(guard, [&] { return started; });
+  }
+
+  if (!pool.submit([] {}) || !pool.submit([] {})) {
+    log << "jobs should be queued up to the queue limit\n";
+    return false;
+  }
+
+  if (pool.queued() != 2) {
+    log << "expected 2 queued jobs, but have " << pool.queued() << "\n";
+    return false;
+  }
+
+  if (pool.submit([] {})) {
+    log << "job should have been turned down with a full queue\n";
+    return false;
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    release = true;
+    changed.notify_all();
+  }
+
+  return true;
+}
+
+namespace test {
+using efgy::test::function;
+
+static function run(testRun);
+static function queueLimit(testQueueLimit);
+}